@@ -0,0 +1,390 @@
+/*
+    This file is part of GNU APL, a free implementation of the
+    ISO/IEC Standard 13751, "Programming Language APL, Extended"
+
+    Copyright (C) 2020 Chris Moller
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#define _GNU_SOURCE
+#include <gtk/gtk.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "render.h"
+#include "curves-model.h"
+#include "curves.h"
+#include "panels.h"
+#include "anim.h"
+#include "eval.h"
+
+/*
+  The worker evaluates and renders frames in order into a ring of
+  ANIM_SLOTS buffers, allocated once and kept across runs of the same
+  size.  A timer on the main thread shows the newest frame that's due
+  and frees the ones it passed over.  When nothing is ready the player
+  either holds the current frame and lets playback slip, if the worker
+  is normally fast enough, or skips the frames the worker hasn't
+  started yet, if it isn't.
+
+  There is a single worker because libapl and plplot are both
+  serialised; more would only queue on their locks.
+*/
+
+#define ANIM_SLOTS	8
+#define DEFAULT_FPS	25.0
+
+typedef enum
+  {
+   SLOT_FREE,
+   SLOT_BUSY,			// being rendered
+   SLOT_READY,
+   SLOT_SHOWN
+  } slot_state_e;
+
+typedef struct {
+  guchar       *pixels;
+  gint          frame;
+  slot_state_e  state;
+} frame_s;
+
+typedef struct {
+  sweep_s       sweep;
+  panel_plot_s  plot;
+  gchar        *title;
+  gint          width;
+  gint          height;
+} job_s;
+
+static struct {
+  GMutex       lock;
+  GCond        cond;
+  GThread     *worker;
+  frame_s      slots[ANIM_SLOTS];
+  gint         pool_width;
+  gint         pool_height;
+  job_s        job;
+  gint         next_frame;	// next frame the worker will start
+  gint64       frame_us;	// smoothed time the worker takes per frame
+  gboolean     stop;
+  gboolean     worker_done;
+  guint        timer;
+  gint64       epoch;		// when frame 0 was due
+  GtkWidget   *widget;
+  GSourceFunc  done;
+  gpointer     done_data;
+} anim;
+
+gboolean
+anim_parse_sweep (const gchar *spec, sweep_s *sweep)
+{
+  gchar **parts = g_strsplit (spec, ":", -1);
+  gboolean rc = FALSE;
+
+  if (g_strv_length (parts) == 4 && *parts[0]) {
+    gchar *end1, *end2, *end3;
+    sweep->from   = g_ascii_strtod (parts[1], &end1);
+    sweep->to     = g_ascii_strtod (parts[2], &end2);
+    sweep->frames = (gint)strtol (parts[3], &end3, 10);
+    /* every step between them must be a number APL can spell */
+    if (!*end1 && !*end2 && !*end3 && sweep->frames > 0
+	&& isfinite (sweep->from) && isfinite (sweep->to)
+	&& isfinite (sweep->to - sweep->from)) {
+      sweep->var = g_strdup (parts[0]);
+      rc = TRUE;
+    }
+  }
+  g_strfreev (parts);
+  return rc;
+}
+
+static void
+produce_frame (const job_s *job, gint frame, guchar *pixels)
+{
+  const sweep_s *sweep = &job->sweep;
+  gdouble param = (sweep->frames > 1)
+    ? sweep->from + (sweep->to - sweep->from)
+      * (gdouble)frame / (gdouble)(sweep->frames - 1)
+    : sweep->from;
+  const panel_plot_s *plot = &job->plot;
+  guint n = g_strv_length (plot->exprs);
+  series_s x = {.values = NULL, .n_values = 0};
+  series_s *ys = g_new0 (series_s, n ? n : 1);
+  guint n_ys = 0;
+
+  eval_lock ();
+  eval_set_variable (sweep->var, param);
+  for (guint i = 0; i < n; i++) {
+    series_s series;
+    gint64 elapsed;
+    series.values =
+      eval_expression (plot->exprs[i], &series.n_values, &elapsed, NULL);
+    if ((gint)i == plot->x_idx) x = series;
+    else ys[n_ys++] = series;
+  }
+  eval_unlock ();
+
+  render_plot (pixels, job->width, job->height, job->title, &x, ys, n_ys,
+	       plot->fixed_range ? plot->range : NULL);
+
+  g_free (x.values);
+  for (guint i = 0; i < n_ys; i++) g_free (ys[i].values);
+  g_free (ys);
+}
+
+static void
+job_clear (job_s *job)
+{
+  g_clear_pointer (&job->sweep.var, g_free);
+  panels_plot_clear (&job->plot);
+  g_clear_pointer (&job->title, g_free);
+}
+
+static frame_s *
+free_slot ()
+{
+  for (gint i = 0; i < ANIM_SLOTS; i++)
+    if (anim.slots[i].state == SLOT_FREE) return &anim.slots[i];
+  return NULL;
+}
+
+static gpointer
+anim_worker (gpointer data)
+{
+  g_mutex_lock (&anim.lock);
+  for (;;) {
+    frame_s *slot = NULL;
+    while (!anim.stop && anim.next_frame < anim.job.sweep.frames
+	   && !(slot = free_slot ()))
+      g_cond_wait (&anim.cond, &anim.lock);
+    if (anim.stop || anim.next_frame >= anim.job.sweep.frames) break;
+
+    slot->frame = anim.next_frame++;
+    slot->state = SLOT_BUSY;
+    g_mutex_unlock (&anim.lock);
+
+    gint64 start = g_get_monotonic_time ();
+    produce_frame (&anim.job, slot->frame, slot->pixels);
+    gint64 took = g_get_monotonic_time () - start;
+
+    g_mutex_lock (&anim.lock);
+    slot->state = SLOT_READY;
+    anim.frame_us = anim.frame_us ? (3 * anim.frame_us + took) / 4 : took;
+  }
+  anim.worker_done = TRUE;
+  g_mutex_unlock (&anim.lock);
+
+  return NULL;
+}
+
+static gboolean
+anim_tick (gpointer data)
+{
+  gint64 period = (gint64)((gdouble)G_USEC_PER_SEC / anim.job.sweep.fps);
+  gint target = (gint)((g_get_monotonic_time () - anim.epoch) / period);
+  frame_s *show = NULL;
+  gboolean pending = FALSE;
+
+  g_mutex_lock (&anim.lock);
+
+  /* the newest frame that's due; anything older is dropped */
+  for (gint i = 0; i < ANIM_SLOTS; i++) {
+    frame_s *slot = &anim.slots[i];
+    if (slot->state == SLOT_READY && slot->frame <= target
+	&& (!show || slot->frame > show->frame))
+      show = slot;
+  }
+
+  if (show) {
+    for (gint i = 0; i < ANIM_SLOTS; i++) {
+      frame_s *slot = &anim.slots[i];
+      if (slot->state == SLOT_SHOWN
+	  || (slot->state == SLOT_READY && slot->frame < show->frame))
+	slot->state = SLOT_FREE;
+    }
+    show->state = SLOT_SHOWN;
+    g_cond_signal (&anim.cond);
+  }
+
+  gboolean ready = FALSE;
+  for (gint i = 0; i < ANIM_SLOTS; i++) {
+    if (anim.slots[i].state == SLOT_READY) ready = TRUE;
+    if (anim.slots[i].state == SLOT_BUSY) pending = TRUE;
+  }
+  pending |= ready;
+
+  /* nothing due and nothing waiting: the worker is behind */
+  if (!show && !ready && !anim.worker_done) {
+    if (anim.frame_us > period) {
+      if (anim.next_frame <= target) anim.next_frame = target + 1;
+    }
+    else anim.epoch += period;
+  }
+
+  /* the last frame stays up for at least the tick after it was shown */
+  gboolean finished = anim.worker_done && !pending && !show;
+  g_mutex_unlock (&anim.lock);
+
+  if (show || finished) gtk_widget_queue_draw (anim.widget);
+  if (!finished) return G_SOURCE_CONTINUE;
+
+  anim.timer = 0;
+  GSourceFunc done = anim.done;
+  gpointer done_data = anim.done_data;
+  anim_stop ();
+  if (done) done (done_data);
+  return G_SOURCE_REMOVE;
+}
+
+void
+anim_start (const sweep_s *sweep, const panel_plot_s *plot,
+	    GtkWidget *widget, const gchar *title,
+	    GSourceFunc done, gpointer data)
+{
+  anim_stop ();
+
+  gint width = gtk_widget_get_allocated_width (widget);
+  gint height = gtk_widget_get_allocated_height (widget);
+  if (width != anim.pool_width || height != anim.pool_height) {
+    for (gint i = 0; i < ANIM_SLOTS; i++) {
+      g_free (anim.slots[i].pixels);
+      anim.slots[i].pixels = g_malloc (4 * (gsize)width * (gsize)height);
+    }
+    anim.pool_width = width;
+    anim.pool_height = height;
+  }
+  for (gint i = 0; i < ANIM_SLOTS; i++) anim.slots[i].state = SLOT_FREE;
+
+  anim.job.sweep = *sweep;
+  anim.job.sweep.var = g_strdup (sweep->var);
+  if (anim.job.sweep.fps <= 0.0) anim.job.sweep.fps = DEFAULT_FPS;
+  anim.job.plot = *plot;
+  anim.job.plot.exprs = g_strdupv (plot->exprs);
+  anim.job.title = g_strdup (title);
+  anim.job.width = width;
+  anim.job.height = height;
+
+  anim.next_frame = 0;
+  anim.frame_us = 0;
+  anim.stop = FALSE;
+  anim.worker_done = FALSE;
+  anim.widget = widget;
+  anim.done = done;
+  anim.done_data = data;
+  anim.epoch = g_get_monotonic_time ();
+
+  anim.worker = g_thread_new ("aplvis-anim", anim_worker, NULL);
+  anim.timer = g_timeout_add ((guint)(1000.0 / anim.job.sweep.fps),
+			      anim_tick, NULL);
+}
+
+void
+anim_stop ()
+{
+  if (!anim.worker) return;
+
+  g_mutex_lock (&anim.lock);
+  anim.stop = TRUE;
+  g_cond_broadcast (&anim.cond);
+  g_mutex_unlock (&anim.lock);
+  g_thread_join (anim.worker);
+  anim.worker = NULL;
+
+  g_mutex_lock (&anim.lock);
+  for (gint i = 0; i < ANIM_SLOTS; i++) anim.slots[i].state = SLOT_FREE;
+  g_mutex_unlock (&anim.lock);
+
+  if (anim.timer) g_source_remove (anim.timer);
+  anim.timer = 0;
+  job_clear (&anim.job);
+}
+
+gboolean
+anim_running ()
+{
+  return anim.worker ? TRUE : FALSE;
+}
+
+gboolean
+anim_draw (cairo_t *cr)
+{
+  frame_s *shown = NULL;
+
+  /* the worker never touches a shown slot, so only the search is locked */
+  g_mutex_lock (&anim.lock);
+  for (gint i = 0; i < ANIM_SLOTS; i++)
+    if (anim.slots[i].state == SLOT_SHOWN) shown = &anim.slots[i];
+  g_mutex_unlock (&anim.lock);
+  if (!shown) return FALSE;
+
+  cairo_surface_t *surface =
+    cairo_image_surface_create_for_data (shown->pixels,
+					 CAIRO_FORMAT_ARGB32,
+					 anim.pool_width,
+					 anim.pool_height,
+					 4 * anim.pool_width);
+  cairo_set_source_surface (cr, surface, 0, 0);
+  cairo_paint (cr);
+  cairo_surface_destroy (surface);
+  return TRUE;
+}
+
+gboolean
+anim_encode (const sweep_s *sweep, gint width, gint height,
+	     const gchar *title, const gchar *dir, GError **error)
+{
+  if (g_mkdir_with_parents (dir, 0755) != 0) {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+		 "%s: %s", dir, g_strerror (errno));
+    return FALSE;
+  }
+
+  job_s job = {.sweep  = *sweep,
+	       .title  = (gchar *)title,
+	       .width  = width,
+	       .height = height};
+  job.plot.exprs = curves_get_expressions (&job.plot.x_idx);
+
+  /* one buffer, reused for every frame */
+  guchar *pixels = g_malloc (4 * (gsize)width * (gsize)height);
+  gboolean rc = TRUE;
+
+  for (gint frame = 0; rc && frame < sweep->frames; frame++) {
+    produce_frame (&job, frame, pixels);
+
+    cairo_surface_t *surface =
+      cairo_image_surface_create_for_data (pixels, CAIRO_FORMAT_ARGB32,
+					   width, height, 4 * width);
+    gchar *fn = g_strdup_printf ("%s/frame-%05d.png", dir, frame);
+    cairo_status_t status = cairo_surface_write_to_png (surface, fn);
+    if (status != CAIRO_STATUS_SUCCESS) {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+		   "%s: %s", fn, cairo_status_to_string (status));
+      rc = FALSE;
+    }
+    g_free (fn);
+    cairo_surface_destroy (surface);
+  }
+
+  g_free (pixels);
+  panels_plot_clear (&job.plot);
+  return rc;
+}
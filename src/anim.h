@@ -0,0 +1,31 @@
+#ifndef ANIM_H
+#define ANIM_H
+
+typedef struct {
+  gchar   *var;			// workspace variable swept
+  gdouble  from;
+  gdouble  to;
+  gint     frames;
+  gdouble  fps;
+} sweep_s;
+
+gboolean anim_parse_sweep (const gchar *spec, sweep_s *sweep);
+
+/* Evaluation and rendering run ahead of playback on a worker thread;
+   done is called on the main thread when playback finishes.  plot is
+   copied, and is usually the panel the animation plays in. */
+void	 anim_start (const sweep_s *sweep, const panel_plot_s *plot,
+		     GtkWidget *widget, const gchar *title,
+		     GSourceFunc done, gpointer data);
+void	 anim_stop ();
+gboolean anim_running ();
+
+/* paints the frame on show, returning FALSE if there isn't one */
+gboolean anim_draw (cairo_t *cr);
+
+/* renders the whole sweep of every curve, against the Curves dialog's
+   X axis, to dir/frame-NNNNN.png without a display */
+gboolean anim_encode (const sweep_s *sweep, gint width, gint height,
+		      const gchar *title, const gchar *dir, GError **error);
+
+#endif  // ANIM_H
@@ -45,7 +45,13 @@
 #include <apl/libapl.h>
 				
 #include "aplvis.h"
+#include "render.h"
+#include "curves-model.h"
 #include "curves.h"
+#include "panels.h"
+#include "anim.h"
+#include "eval.h"
+#include "snapshot.h"
 
 static char            *newfn;
 static FILE            *newout;
@@ -54,6 +60,22 @@ static GFileMonitor    *monitor_file;
 static gulong           monitor_sigid;
 static GtkWidget       *status;
 static gint             granularity;
+static sweep_s          sweep		= {NULL, 0.0, 1.0, 50, 25.0};
+static GtkWidget       *anim_var;
+static GtkWidget       *anim_from;
+static GtkWidget       *anim_to;
+static GtkWidget       *anim_frames;
+static GtkWidget       *anim_fps;
+static GtkWidget       *anim_button;
+static GtkWidget       *go_button;
+static GtkWidget       *layout_rows;
+static GtkWidget       *layout_cols;
+static gchar           *ws_file;
+static gboolean         warm_start;
+static snapshot_s      *warm;		// shown until the first real plot
+static gboolean         startup_trace;
+static gint64           startup_epoch;
+static gboolean         first_plot_pending;
 
 
 #define DEFAULT_WIDTH  480
@@ -67,71 +89,58 @@ GtkAdjustment   *gran_adj	 = NULL;
 GtkWidget       *gran_spin	 = NULL;
 
 
+static void
+startup_mark (const gchar *what)
+{
+  if (startup_trace)
+    fprintf (stderr, "aplvis: %9.1f ms  %s\n",
+	     (gdouble)(g_get_monotonic_time () - startup_epoch) / 1000.0, what);
+}
+
 static gboolean
 da_draw_cb (GtkWidget *widget, cairo_t *cr, gpointer data)
 {
-  PLPointer pbuf = NULL;
-  cairo_surface_t *surface = NULL;
-  guint width = gtk_widget_get_allocated_width (widget);
-  guint height = gtk_widget_get_allocated_height (widget);
-  pbuf = g_malloc0 (4 * width * height);
-  if (pbuf) {
-    plsdev ("memcairo");
-    plsmema ((PLINT)width, (PLINT)height, pbuf);
-    surface =
-      cairo_image_surface_create_for_data (pbuf,
-                                           CAIRO_FORMAT_ARGB32,
-                                           (PLINT)width,
-                                           (PLINT)height,
-                                           4 * (PLINT)width);
-    cairo_set_source_surface (cr, surface, 0, 0);
-
-#if 1
-    cairo_rectangle (cr, 0.0, 0.0, (PLFLT)width, (PLFLT)height);
-    cairo_set_source_rgba (cr, 0.5, 0.6, 0.7, 1.0);
-#else
-    plinit();
-    int cx;
-    for (cx = 0; cx < 16; cx++)
-      plscol0a (cx,
-                trunc (255.0 * base_colours[cx].red),
-                trunc (255.0 * base_colours[cx].green),
-                trunc (255.0 * base_colours[cx].blue),
-                base_colours[cx].alpha);
-
-
-    /* set bg */
-    cairo_rectangle (cr, 0.0, 0.0, (PLFLT)width, (PLFLT)height);
-    cairo_set_source_rgba (cr,
-                           bg_colour.red,
-                           bg_colour.green,
-                           bg_colour.blue,
-                           bg_colour.alpha);
-    cairo_fill (cr);
-
-    plcol0 (0);                 // sets axes
-    if (xvec) {
-      plenv (xmin, xmax, ymin, ymax, 0, 0);
-      plcol0 (7);                       // sets axes
-      pllab (x_label, y_label, gtk_entry_get_text (GTK_ENTRY (title)));
-      plssym (0.0, 0.75);
-      plcol0 (5);               // sets curves
-      plline (count, xvec, yvec);
-    }
-
-    plend ();
-#endif
+  static gboolean first_draw = TRUE;
+  if (first_draw) {
+    startup_mark ("window drawn");
+    first_draw = FALSE;
+  }
 
+  if (anim_draw (cr)) return GDK_EVENT_STOP;
 
+  if (warm && warm->pixels) {
+    cairo_surface_t *surface =
+      cairo_image_surface_create_for_data ((guchar *)warm->pixels,
+					   CAIRO_FORMAT_ARGB32,
+					   warm->width,
+					   warm->height,
+					   4 * warm->width);
+    cairo_set_source_surface (cr, surface, 0, 0);
     cairo_paint (cr);
-    g_free (pbuf);
+    cairo_surface_destroy (surface);
+    static gboolean first_warm = TRUE;
+    if (first_warm) {
+      startup_mark ("warm-start frame shown");
+      first_warm = FALSE;
+    }
+    return GDK_EVENT_STOP;
   }
-  else {                // fixme error
+
+  if (panels_draw (0, cr) && first_plot_pending) {
+    startup_mark ("first plot");
+    first_plot_pending = FALSE;
   }
 
   return GDK_EVENT_STOP;
 }
 
+static void
+title_changed_cb (GtkEditable *editable,
+		  gpointer     user_data)
+{
+  panels_refresh ();
+}
+
 static void
 spin_changed_cb (GtkSpinButton *spin_button,
                  gpointer       user_data)
@@ -153,19 +162,151 @@ curves_button_cb (GtkButton *button,
 		  gpointer   user_data)
 {
   curves_screen ();
+
+  /* panels following the dialog's X axis pick up a new one */
+  panels_refresh ();
 }
 
 static void
 go_button_cb (GtkButton *button,
               gpointer   user_data)
 {
-  //  expression_activate_cb (NULL, NULL);
+  panels_sync ();
+  curves_evaluate ();
+  panels_refresh ();
+}
+
+static void
+layout_changed_cb (GtkSpinButton *spin_button,
+		   gpointer       user_data)
+{
+  panels_set_layout
+    (gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (layout_rows)),
+     gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (layout_cols)));
 }
 
+static gboolean
+anim_done (gpointer user_data)
+{
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (anim_button), FALSE);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+anim_button_cb (GtkToggleButton *button,
+		gpointer         user_data)
+{
+  if (!gtk_toggle_button_get_active (button)) {
+    anim_stop ();
+    gtk_widget_queue_draw (da);
+    return;
+  }
+
+  const gchar *var = gtk_entry_get_text (GTK_ENTRY (anim_var));
+  if (!*var) {
+    gtk_label_set_text (GTK_LABEL (status), _ ("No sweep variable"));
+    gtk_toggle_button_set_active (button, FALSE);
+    return;
+  }
+
+  g_free (sweep.var);
+  sweep.var = g_strdup (var);
+  sweep.from =
+    gtk_spin_button_get_value (GTK_SPIN_BUTTON (anim_from));
+  sweep.to =
+    gtk_spin_button_get_value (GTK_SPIN_BUTTON (anim_to));
+  sweep.frames =
+    gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (anim_frames));
+  sweep.fps =
+    gtk_spin_button_get_value (GTK_SPIN_BUTTON (anim_fps));
+  panel_plot_s plot;
+  panels_get_plot (0, &plot);
+  anim_start (&sweep, &plot, da, gtk_entry_get_text (GTK_ENTRY (title)),
+	      anim_done, NULL);
+  panels_plot_clear (&plot);
+}
+
+
+typedef struct {
+  gchar   *ws;
+  gchar  **expressions;		// to catch up on, NULL if none
+  GArray  *results;
+} init_s;
+
+static gboolean
+init_done (gpointer data)
+{
+  init_s *init = data;
+
+  gtk_widget_set_sensitive (go_button, TRUE);
+  gtk_widget_set_sensitive (anim_button, TRUE);
+  gtk_label_set_text (GTK_LABEL (status), _ ("Ready"));
+
+  if (init->results) {
+    panels_sync ();
+    curves_record (init->expressions, init->results);
+    first_plot_pending = TRUE;
+  }
+  g_strfreev (init->expressions);
+  g_free (init->ws);
+  g_free (init);
+
+  snapshot_free (warm);
+  warm = NULL;
+  gtk_widget_queue_draw (da);
+  panels_refresh ();
+
+  return G_SOURCE_REMOVE;
+}
+
+/* the window keeps whatever the warm start or command line showed
+   while this catches up */
+static gpointer
+init_thread (gpointer data)
+{
+  init_s *init = data;
+
+  eval_lock ();
+  eval_init ();
+  startup_mark ("libapl initialised");
+  if (init->ws) {
+    gchar *cmd = g_strdup_printf (")LOAD %s", init->ws);
+    eval_command (cmd);
+    g_free (cmd);
+    startup_mark ("workspace loaded");
+  }
+  if (init->expressions) {
+    init->results = curves_evaluate_expressions (init->expressions);
+    startup_mark ("curves evaluated");
+  }
+  eval_unlock ();
+
+  g_idle_add (init_done, init);
+  return NULL;
+}
 
 static void
 aplvis_quit (GtkWidget *object, gpointer data)
 {
+  anim_stop ();
+  if (warm_start) {
+    GError *error = NULL;
+    gchar *dir = snapshot_dir ();
+    gint w, h;
+    const guchar *pixels = panels_get_pixels (0, &w, &h);
+    if (!pixels && warm) {	// quit before anything replaced it
+      pixels = warm->pixels;
+      w = warm->width;
+      h = warm->height;
+    }
+    eval_lock ();		// waits out a slow start
+    if (!snapshot_save (dir, pixels, w, h, &error)) {
+      fprintf (stderr, "%s\n", error->message);
+      g_error_free (error);
+    }
+    eval_unlock ();
+    g_free (dir);
+  }
   unlink (newfn);
   gtk_main_quit ();
 }
@@ -259,11 +400,66 @@ ctl_panel ()
 
   /************* go button **********/
 
-  GtkWidget *go_button = gtk_button_new_with_label (_ ("Go"));
+  go_button = gtk_button_new_with_label (_ ("Go"));
   g_signal_connect (go_button, "clicked",
                     G_CALLBACK (go_button_cb), NULL);
   gtk_box_pack_start (GTK_BOX (vbox), GTK_WIDGET (go_button), FALSE, FALSE, 2);
 
+  /************* animation **********/
+
+  frame = gtk_frame_new (_ ("Animation"));
+  gtk_box_pack_start (GTK_BOX (vbox), GTK_WIDGET (frame), FALSE, FALSE, 2);
+  GtkWidget *grid = gtk_grid_new ();
+  gtk_container_add (GTK_CONTAINER (frame), grid);
+
+  anim_var = gtk_entry_new ();
+  gtk_entry_set_placeholder_text (GTK_ENTRY (anim_var),  _ ("Variable"));
+  if (sweep.var) gtk_entry_set_text (GTK_ENTRY (anim_var), sweep.var);
+  gtk_grid_attach (GTK_GRID (grid), anim_var, 0, 0, 2, 1);
+
+  anim_from = gtk_spin_button_new_with_range (-G_MAXFLOAT, G_MAXFLOAT, 0.1);
+  gtk_spin_button_set_value (GTK_SPIN_BUTTON (anim_from), sweep.from);
+  gtk_grid_attach (GTK_GRID (grid), gtk_label_new (_ ("From")), 0, 1, 1, 1);
+  gtk_grid_attach (GTK_GRID (grid), anim_from, 1, 1, 1, 1);
+
+  anim_to = gtk_spin_button_new_with_range (-G_MAXFLOAT, G_MAXFLOAT, 0.1);
+  gtk_spin_button_set_value (GTK_SPIN_BUTTON (anim_to), sweep.to);
+  gtk_grid_attach (GTK_GRID (grid), gtk_label_new (_ ("To")), 0, 2, 1, 1);
+  gtk_grid_attach (GTK_GRID (grid), anim_to, 1, 2, 1, 1);
+
+  anim_frames = gtk_spin_button_new_with_range (1, 100000, 1);
+  gtk_spin_button_set_value (GTK_SPIN_BUTTON (anim_frames), sweep.frames);
+  gtk_grid_attach (GTK_GRID (grid), gtk_label_new (_ ("Frames")), 0, 3, 1, 1);
+  gtk_grid_attach (GTK_GRID (grid), anim_frames, 1, 3, 1, 1);
+
+  anim_fps = gtk_spin_button_new_with_range (1, 120, 1);
+  gtk_spin_button_set_value (GTK_SPIN_BUTTON (anim_fps), sweep.fps);
+  gtk_grid_attach (GTK_GRID (grid), gtk_label_new (_ ("FPS")), 0, 4, 1, 1);
+  gtk_grid_attach (GTK_GRID (grid), anim_fps, 1, 4, 1, 1);
+
+  anim_button = gtk_toggle_button_new_with_label (_ ("Play"));
+  g_signal_connect (anim_button, "toggled",
+                    G_CALLBACK (anim_button_cb), NULL);
+  gtk_grid_attach (GTK_GRID (grid), anim_button, 0, 5, 2, 1);
+
+  /************* layout **********/
+
+  frame = gtk_frame_new (_ ("Panels"));
+  gtk_box_pack_start (GTK_BOX (vbox), GTK_WIDGET (frame), FALSE, FALSE, 2);
+  grid = gtk_grid_new ();
+  gtk_container_add (GTK_CONTAINER (frame), grid);
+
+  layout_rows = gtk_spin_button_new_with_range (1, 4, 1);
+  g_signal_connect (layout_rows, "value-changed",
+                    G_CALLBACK (layout_changed_cb), NULL);
+  gtk_grid_attach (GTK_GRID (grid), gtk_label_new (_ ("Rows")), 0, 0, 1, 1);
+  gtk_grid_attach (GTK_GRID (grid), layout_rows, 1, 0, 1, 1);
+
+  layout_cols = gtk_spin_button_new_with_range (1, 4, 1);
+  g_signal_connect (layout_cols, "value-changed",
+                    G_CALLBACK (layout_changed_cb), NULL);
+  gtk_grid_attach (GTK_GRID (grid), gtk_label_new (_ ("Columns")), 0, 1, 1, 1);
+  gtk_grid_attach (GTK_GRID (grid), layout_cols, 1, 1, 1, 1);
 
   return vbox;
 }
@@ -311,6 +507,8 @@ sigint_handler (int sig, siginfo_t *si, void *data)
 int
 main (int ac, char *av[])
 {
+  startup_epoch = g_get_monotonic_time ();
+
   struct sigaction action;
   action.sa_sigaction = sigint_handler;
   sigemptyset (&action.sa_mask);
@@ -332,20 +530,94 @@ main (int ac, char *av[])
   monitor_sigid = g_signal_connect (G_OBJECT(monitor_file), "changed",
 				    G_CALLBACK (monitor_changed), NULL);
 
+  gchar  **curve_exprs = NULL;
+  gchar   *sweep_spec  = NULL;
+  gdouble  fps         = 0.0;
+  gchar   *frames_dir  = NULL;
   GOptionEntry entries[] =
     {
 #if 0
      { "setvar", 'v', 0, G_OPTION_ARG_STRING_ARRAY,
        &vars, "Set variable.", NULL },
 #endif
+     { "curve", 'c', 0, G_OPTION_ARG_STRING_ARRAY,
+       &curve_exprs, "Add a curve.", "EXPR" },
+     { "sweep", 's', 0, G_OPTION_ARG_STRING,
+       &sweep_spec, "Animate VAR from FROM to TO in FRAMES steps.",
+       "VAR:FROM:TO:FRAMES" },
+     { "fps", 'r', 0, G_OPTION_ARG_DOUBLE,
+       &fps, "Animation frame rate.", "N" },
+     { "frames", 'o', 0, G_OPTION_ARG_FILENAME,
+       &frames_dir, "Write the sweep to DIR as PNGs without a window.",
+       "DIR" },
+     { "load", 'l', 0, G_OPTION_ARG_FILENAME,
+       &ws_file, "Load an APL workspace.", "WS" },
+     { "warm-start", 'w', 0, G_OPTION_ARG_NONE,
+       &warm_start, "Show the last session's plot at once, and save it "
+       "again on exit.", NULL },
+     { "startup-trace", 't', 0, G_OPTION_ARG_NONE,
+       &startup_trace, "Report the time to first plot.", NULL },
      { NULL }
   };
 
   GOptionContext *context = g_option_context_new ("string string string...");
   g_option_context_add_main_entries (context, entries, NULL);
-  g_option_context_add_group (context, gtk_get_option_group (TRUE));
+  g_option_context_add_group (context, gtk_get_option_group (FALSE));
+
+  GError *error = NULL;
+  if (!g_option_context_parse (context, &ac, &av, &error)) {
+    fprintf (stderr, "%s\n", error->message);
+    unlink (newfn);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  if (sweep_spec && !anim_parse_sweep (sweep_spec, &sweep)) {
+    fprintf (stderr, "Bad sweep: %s\n", sweep_spec);
+    unlink (newfn);
+    return 1;
+  }
+  if (fps > 0.0) sweep.fps = fps;
 
-  init_libapl ("apl", 0);
+  for (gchar **expr = curve_exprs; expr && *expr; expr++)
+    curves_add (*expr, *expr);
+
+  if (frames_dir) {
+    if (!sweep.var) {
+      fprintf (stderr, "--frames needs --sweep\n");
+      unlink (newfn);
+      return 1;
+    }
+    if (curves_empty ()) {
+      fprintf (stderr, "--frames needs at least one --curve\n");
+      unlink (newfn);
+      return 1;
+    }
+    eval_init ();
+    if (ws_file) {
+      gchar *cmd = g_strdup_printf (")LOAD %s", ws_file);
+      eval_command (cmd);
+      g_free (cmd);
+    }
+    gboolean ok = anim_encode (&sweep, width, height, NULL,
+			       frames_dir, &error);
+    if (!ok) fprintf (stderr, "%s\n", error->message);
+    unlink (newfn);
+    return ok ? 0 : 1;
+  }
+
+  /* the snapshot's curves only make sense in the snapshot's workspace,
+     so a workspace or curves named on the command line win */
+  if (warm_start) {
+    gchar *dir = snapshot_dir ();
+    if (curves_empty () && !ws_file) warm = snapshot_load (dir);
+    if (warm) ws_file = snapshot_workspace (dir);
+    g_free (dir);
+    startup_mark (warm ? "warm-start snapshot mapped" : "no warm-start snapshot");
+  }
+
+  /* with nothing to evaluate the first render is the first plot */
+  first_plot_pending = curves_empty ();
 
   gtk_init (&ac, &av);
 
@@ -382,6 +654,8 @@ main (int ac, char *av[])
   g_signal_connect (title, "activate",
                     G_CALLBACK (expression_activate_cb), NULL);
 #endif
+  g_signal_connect (title, "changed",
+                    G_CALLBACK (title_changed_cb), NULL);
   gtk_grid_attach (GTK_GRID (grid), title, col, row, 1, 1);
   gtk_entry_set_placeholder_text (GTK_ENTRY (title),  _ ("Title"));
 
@@ -398,16 +672,14 @@ main (int ac, char *av[])
   gtk_widget_set_size_request (da, width, height);
   g_signal_connect (da, "draw",
                     G_CALLBACK (da_draw_cb), NULL);
-  gtk_widget_set_hexpand (da, TRUE);
-  gtk_widget_set_vexpand (da, TRUE);
-  gtk_grid_attach (GTK_GRID (grid), da, col, row, 1, 1);
+  gtk_grid_attach (GTK_GRID (grid), panels_new (da), col, row, 1, 1);
 
   /********** status bar ******/
 
   row = 2;
   col = 0;
 
-  status = gtk_label_new ("status");
+  status = gtk_label_new (_ ("Starting APL..."));
   gtk_grid_attach (GTK_GRID (grid), status, col++, row, 1, 1);
 
   /******* end grid ******/
@@ -419,7 +691,19 @@ main (int ac, char *av[])
 #endif
   }
 
+  /* nothing may touch libapl until init_thread is through */
+  gtk_widget_set_sensitive (go_button, FALSE);
+  gtk_widget_set_sensitive (anim_button, FALSE);
+
   gtk_widget_show_all (window);
+  startup_mark ("window shown");
+  init_s *init = g_new0 (init_s, 1);
+  init->ws = g_strdup (ws_file);
+  if (!curves_empty ()) {
+    gint x_idx;
+    init->expressions = curves_get_expressions (&x_idx);
+  }
+  g_thread_unref (g_thread_new ("aplvis-init", init_thread, init));
   gtk_main ();
 
 }
@@ -0,0 +1,876 @@
+/*
+    This file is part of GNU APL, a free implementation of the
+    ISO/IEC Standard 13751, "Programming Language APL, Extended"
+
+    Copyright (C) 2020 Chris Moller
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#define _GNU_SOURCE
+#include <gtk/gtk.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "curves-model.h"
+#include "eval.h"
+
+/*
+  rows maps each visible row to a curve index and row_of maps back,
+  -1 for hidden curves.  Both are NULL while the model is neither
+  filtered nor sorted, when a row and its curve index are the same.
+*/
+
+struct _CurvesModel
+{
+  GObject      parent;
+  GArray      *curves;		// curve_s, in insertion order
+  GArray      *rows;		// guint
+  GArray      *row_of;		// gint
+  gchar       *filter;		// casefolded filter text
+  gint         sort_column;
+  GtkSortType  sort_order;
+  gint         radio[2];	// selected curve per radio column, -1 if none
+  gint         stamp;
+};
+
+static void curves_model_tree_model_init (GtkTreeModelIface *iface);
+static void curves_model_tree_sortable_init (GtkTreeSortableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (CurvesModel, curves_model, G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+						curves_model_tree_model_init)
+			 G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_SORTABLE,
+						curves_model_tree_sortable_init))
+
+static GType column_types[N_COLUMNS];
+
+static void
+curve_release_values (curve_s *curve)
+{
+  if (curve->mapping) {
+    g_mapped_file_unref (curve->mapping);
+    curve->mapping = NULL;
+  }
+  else g_free (curve->values);
+  curve->values = NULL;
+}
+
+static void
+curve_clear (gpointer data)
+{
+  curve_s *curve = data;
+  g_free (curve->label);
+  g_free (curve->expression);
+  g_free (curve->key);
+  curve_release_values (curve);
+  g_free (curve->stats.samples);
+  if (curve->profile) g_array_unref (curve->profile);
+}
+
+static inline gdouble
+curve_mean (curve_s *curve)
+{
+  return curve->stats.count
+    ? (gdouble)curve->stats.total / (gdouble)curve->stats.count : 0.0;
+}
+
+static const gchar *
+curve_key (curve_s *curve)
+{
+  if (!curve->key) {
+    gchar *joined = g_strconcat (curve->label, "\n", curve->expression, NULL);
+    curve->key = g_utf8_casefold (joined, -1);
+    g_free (joined);
+  }
+  return curve->key;
+}
+
+static gboolean
+curve_matches (curve_s *curve, const gchar *filter)
+{
+  return strstr (curve_key (curve), filter) ? TRUE : FALSE;
+}
+
+static inline guint
+n_rows (CurvesModel *model)
+{
+  return model->rows ? model->rows->len : model->curves->len;
+}
+
+static inline guint
+row_to_index (CurvesModel *model, guint row)
+{
+  return model->rows ? g_array_index (model->rows, guint, row) : row;
+}
+
+static inline gint
+index_to_row (CurvesModel *model, guint idx)
+{
+  return model->row_of ? g_array_index (model->row_of, gint, idx) : (gint)idx;
+}
+
+#define CMP(a, b) (((a) > (b)) - ((a) < (b)))
+
+static gint
+compare_rows (gconstpointer a, gconstpointer b, gpointer data)
+{
+  CurvesModel *model = data;
+  guint ia = *(const guint *)a;
+  guint ib = *(const guint *)b;
+  curve_s *ca = &g_array_index (model->curves, curve_s, ia);
+  curve_s *cb = &g_array_index (model->curves, curve_s, ib);
+  gint rc = 0;
+
+  switch (model->sort_column) {
+  case LABEL_COLUMN:
+    rc = g_utf8_collate (ca->label, cb->label);
+    break;
+  case EXPRESSION_COLUMN:
+    rc = g_utf8_collate (ca->expression, cb->expression);
+    break;
+  case EVAL_COUNT_COLUMN:
+    rc = CMP (ca->stats.count, cb->stats.count);
+    break;
+  case LAST_TIME_COLUMN:
+    rc = CMP (ca->stats.last, cb->stats.last);
+    break;
+  case MEAN_TIME_COLUMN:
+    rc = CMP (curve_mean (ca), curve_mean (cb));
+    break;
+  case P99_TIME_COLUMN:
+    rc = CMP (ca->stats.p99, cb->stats.p99);
+    break;
+  case RESULT_SIZE_COLUMN:
+    rc = CMP (ca->stats.result_size, cb->stats.result_size);
+    break;
+  case BYTES_COLUMN:
+    rc = CMP (ca->stats.bytes, cb->stats.bytes);
+    break;
+  }
+  if (model->sort_order == GTK_SORT_DESCENDING) rc = -rc;
+  return rc ? rc : CMP (ia, ib);
+}
+
+/* takes ownership of rows, which may be NULL for every curve */
+static void
+rebuild_rows (CurvesModel *model, GArray *rows)
+{
+  if (!model->filter && model->sort_column < 0) {
+    if (rows) g_array_unref (rows);
+    rows = NULL;
+  }
+  else {
+    if (!rows) {
+      rows = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+				model->curves->len);
+      for (guint i = 0; i < model->curves->len; i++)
+	g_array_append_val (rows, i);
+    }
+    g_array_sort_with_data (rows, compare_rows, model);
+  }
+
+  if (model->rows) g_array_unref (model->rows);
+  if (model->row_of) g_array_unref (model->row_of);
+  model->rows = rows;
+  model->row_of = NULL;
+
+  if (rows) {
+    model->row_of = g_array_sized_new (FALSE, FALSE, sizeof (gint),
+				       model->curves->len);
+    g_array_set_size (model->row_of, model->curves->len);
+    for (guint i = 0; i < model->curves->len; i++)
+      g_array_index (model->row_of, gint, i) = -1;
+    for (guint i = 0; i < rows->len; i++)
+      g_array_index (model->row_of, gint, g_array_index (rows, guint, i))
+	= (gint)i;
+  }
+}
+
+static inline void
+set_iter (CurvesModel *model, GtkTreeIter *iter, guint row)
+{
+  iter->stamp = model->stamp;
+  iter->user_data = GUINT_TO_POINTER (row);
+}
+
+static inline guint
+iter_row (GtkTreeIter *iter)
+{
+  return GPOINTER_TO_UINT (iter->user_data);
+}
+
+static void
+curves_model_index_changed (CurvesModel *model, gint idx)
+{
+  if (idx < 0) return;
+  gint row = index_to_row (model, (guint)idx);
+  if (row < 0) return;
+
+  GtkTreeIter iter;
+  set_iter (model, &iter, (guint)row);
+  GtkTreePath *path = gtk_tree_path_new_from_indices (row, -1);
+  gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, &iter);
+  gtk_tree_path_free (path);
+}
+
+
+/********* GtkTreeModel *********/
+
+static GtkTreeModelFlags
+curves_model_get_flags (GtkTreeModel *tree_model)
+{
+  return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+curves_model_get_n_columns (GtkTreeModel *tree_model)
+{
+  return N_COLUMNS;
+}
+
+static GType
+curves_model_get_column_type (GtkTreeModel *tree_model, gint index)
+{
+  g_return_val_if_fail (index >= 0 && index < N_COLUMNS, G_TYPE_INVALID);
+  return column_types[index];
+}
+
+static gboolean
+curves_model_get_iter (GtkTreeModel *tree_model,
+		       GtkTreeIter  *iter,
+		       GtkTreePath  *path)
+{
+  CurvesModel *model = CURVES_MODEL (tree_model);
+
+  if (gtk_tree_path_get_depth (path) != 1) return FALSE;
+  gint row = gtk_tree_path_get_indices (path)[0];
+  if (row < 0 || (guint)row >= n_rows (model)) return FALSE;
+
+  set_iter (model, iter, (guint)row);
+  return TRUE;
+}
+
+static GtkTreePath *
+curves_model_get_path (GtkTreeModel *tree_model,
+		       GtkTreeIter  *iter)
+{
+  g_return_val_if_fail (iter->stamp == CURVES_MODEL (tree_model)->stamp,
+			NULL);
+  return gtk_tree_path_new_from_indices ((gint)iter_row (iter), -1);
+}
+
+static void
+curves_model_get_value (GtkTreeModel *tree_model,
+			GtkTreeIter  *iter,
+			gint          column,
+			GValue       *value)
+{
+  CurvesModel *model = CURVES_MODEL (tree_model);
+
+  g_return_if_fail (column >= 0 && column < N_COLUMNS);
+  g_return_if_fail (iter->stamp == model->stamp);
+
+  guint idx = row_to_index (model, iter_row (iter));
+  curve_s *curve = &g_array_index (model->curves, curve_s, idx);
+
+  g_value_init (value, column_types[column]);
+  switch (column) {
+  case INDEPENDENT_X_RADIO_COLUMN:
+  case INDEPENDENT_Z_RADIO_COLUMN:
+    g_value_set_boolean (value, model->radio[column] == (gint)idx);
+    break;
+  case LABEL_COLUMN:
+    g_value_set_string (value, curve->label);
+    break;
+  case EXPRESSION_COLUMN:
+    g_value_set_string (value, curve->expression);
+    break;
+  case EVAL_COUNT_COLUMN:
+    g_value_set_uint (value, curve->stats.count);
+    break;
+  case LAST_TIME_COLUMN:
+    g_value_set_double (value, (gdouble)curve->stats.last / 1000.0);
+    break;
+  case MEAN_TIME_COLUMN:
+    g_value_set_double (value, curve_mean (curve) / 1000.0);
+    break;
+  case P99_TIME_COLUMN:
+    g_value_set_double (value, (gdouble)curve->stats.p99 / 1000.0);
+    break;
+  case RESULT_SIZE_COLUMN:
+    g_value_set_uint64 (value, curve->stats.result_size);
+    break;
+  case BYTES_COLUMN:
+    g_value_set_uint64 (value, curve->stats.bytes);
+    break;
+  }
+}
+
+static gboolean
+curves_model_iter_next (GtkTreeModel *tree_model,
+			GtkTreeIter  *iter)
+{
+  CurvesModel *model = CURVES_MODEL (tree_model);
+  guint row = iter_row (iter) + 1;
+
+  if (row >= n_rows (model)) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+  set_iter (model, iter, row);
+  return TRUE;
+}
+
+static gboolean
+curves_model_iter_previous (GtkTreeModel *tree_model,
+			    GtkTreeIter  *iter)
+{
+  CurvesModel *model = CURVES_MODEL (tree_model);
+  guint row = iter_row (iter);
+
+  if (row == 0) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+  set_iter (model, iter, row - 1);
+  return TRUE;
+}
+
+static gboolean
+curves_model_iter_nth_child (GtkTreeModel *tree_model,
+			     GtkTreeIter  *iter,
+			     GtkTreeIter  *parent,
+			     gint          n)
+{
+  CurvesModel *model = CURVES_MODEL (tree_model);
+
+  if (parent || n < 0 || (guint)n >= n_rows (model)) return FALSE;
+  set_iter (model, iter, (guint)n);
+  return TRUE;
+}
+
+static gboolean
+curves_model_iter_children (GtkTreeModel *tree_model,
+			    GtkTreeIter  *iter,
+			    GtkTreeIter  *parent)
+{
+  return curves_model_iter_nth_child (tree_model, iter, parent, 0);
+}
+
+static gboolean
+curves_model_iter_has_child (GtkTreeModel *tree_model,
+			     GtkTreeIter  *iter)
+{
+  return FALSE;
+}
+
+static gint
+curves_model_iter_n_children (GtkTreeModel *tree_model,
+			      GtkTreeIter  *iter)
+{
+  return iter ? 0 : (gint)n_rows (CURVES_MODEL (tree_model));
+}
+
+static gboolean
+curves_model_iter_parent (GtkTreeModel *tree_model,
+			  GtkTreeIter  *iter,
+			  GtkTreeIter  *child)
+{
+  return FALSE;
+}
+
+static void
+curves_model_tree_model_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags       = curves_model_get_flags;
+  iface->get_n_columns   = curves_model_get_n_columns;
+  iface->get_column_type = curves_model_get_column_type;
+  iface->get_iter        = curves_model_get_iter;
+  iface->get_path        = curves_model_get_path;
+  iface->get_value       = curves_model_get_value;
+  iface->iter_next       = curves_model_iter_next;
+  iface->iter_previous   = curves_model_iter_previous;
+  iface->iter_children   = curves_model_iter_children;
+  iface->iter_has_child  = curves_model_iter_has_child;
+  iface->iter_n_children = curves_model_iter_n_children;
+  iface->iter_nth_child  = curves_model_iter_nth_child;
+  iface->iter_parent     = curves_model_iter_parent;
+}
+
+
+/********* GtkTreeSortable *********/
+
+static gboolean
+curves_model_get_sort_column_id (GtkTreeSortable *sortable,
+				 gint            *sort_column_id,
+				 GtkSortType     *order)
+{
+  CurvesModel *model = CURVES_MODEL (sortable);
+
+  if (sort_column_id) *sort_column_id = model->sort_column;
+  if (order) *order = model->sort_order;
+  return model->sort_column >= 0;
+}
+
+static void
+curves_model_set_sort_column_id (GtkTreeSortable *sortable,
+				 gint             sort_column_id,
+				 GtkSortType      order)
+{
+  CurvesModel *model = CURVES_MODEL (sortable);
+
+  if (sort_column_id == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID)
+    sort_column_id = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+  if (model->sort_column == sort_column_id && model->sort_order == order)
+    return;
+
+  model->sort_column = sort_column_id;
+  model->sort_order = order;
+  gtk_tree_sortable_sort_column_changed (sortable);
+  curves_model_resort (model);
+}
+
+static void
+curves_model_set_sort_func (GtkTreeSortable        *sortable,
+			    gint                    sort_column_id,
+			    GtkTreeIterCompareFunc  sort_func,
+			    gpointer                user_data,
+			    GDestroyNotify          destroy)
+{
+  g_warning ("CurvesModel sorts only on its own columns");
+}
+
+static void
+curves_model_set_default_sort_func (GtkTreeSortable        *sortable,
+				    GtkTreeIterCompareFunc  sort_func,
+				    gpointer                user_data,
+				    GDestroyNotify          destroy)
+{
+  g_warning ("CurvesModel sorts only on its own columns");
+}
+
+static gboolean
+curves_model_has_default_sort_func (GtkTreeSortable *sortable)
+{
+  return FALSE;
+}
+
+static void
+curves_model_tree_sortable_init (GtkTreeSortableIface *iface)
+{
+  iface->get_sort_column_id    = curves_model_get_sort_column_id;
+  iface->set_sort_column_id    = curves_model_set_sort_column_id;
+  iface->set_sort_func         = curves_model_set_sort_func;
+  iface->set_default_sort_func = curves_model_set_default_sort_func;
+  iface->has_default_sort_func = curves_model_has_default_sort_func;
+}
+
+
+/********* GObject *********/
+
+static void
+curves_model_finalize (GObject *object)
+{
+  CurvesModel *model = CURVES_MODEL (object);
+
+  g_array_unref (model->curves);
+  if (model->rows) g_array_unref (model->rows);
+  if (model->row_of) g_array_unref (model->row_of);
+  g_free (model->filter);
+
+  G_OBJECT_CLASS (curves_model_parent_class)->finalize (object);
+}
+
+static void
+curves_model_class_init (CurvesModelClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = curves_model_finalize;
+
+  column_types[INDEPENDENT_X_RADIO_COLUMN] = G_TYPE_BOOLEAN;
+  column_types[INDEPENDENT_Z_RADIO_COLUMN] = G_TYPE_BOOLEAN;
+  column_types[LABEL_COLUMN]               = G_TYPE_STRING;
+  column_types[EXPRESSION_COLUMN]          = G_TYPE_STRING;
+  column_types[EVAL_COUNT_COLUMN]          = G_TYPE_UINT;
+  column_types[LAST_TIME_COLUMN]           = G_TYPE_DOUBLE;
+  column_types[MEAN_TIME_COLUMN]           = G_TYPE_DOUBLE;
+  column_types[P99_TIME_COLUMN]            = G_TYPE_DOUBLE;
+  column_types[RESULT_SIZE_COLUMN]         = G_TYPE_UINT64;
+  column_types[BYTES_COLUMN]               = G_TYPE_UINT64;
+}
+
+static void
+curves_model_init (CurvesModel *model)
+{
+  model->curves = g_array_new (FALSE, FALSE, sizeof (curve_s));
+  g_array_set_clear_func (model->curves, curve_clear);
+  model->rows = NULL;
+  model->row_of = NULL;
+  model->filter = NULL;
+  model->sort_column = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+  model->sort_order = GTK_SORT_ASCENDING;
+  model->radio[INDEPENDENT_X_RADIO_COLUMN] = -1;
+  model->radio[INDEPENDENT_Z_RADIO_COLUMN] = -1;
+  model->stamp = g_random_int ();
+}
+
+
+/********* public *********/
+
+CurvesModel *
+curves_model_new ()
+{
+  return g_object_new (CURVES_TYPE_MODEL, NULL);
+}
+
+guint
+curves_model_append (CurvesModel *model,
+		     const gchar *label,
+		     const gchar *expression)
+{
+  curve_s curve = {.label      = g_strdup (label),
+		   .expression = g_strdup (expression)};
+  g_array_append_val (model->curves, curve);
+  guint idx = model->curves->len - 1;
+  guint row = idx;
+
+  if (model->rows) {
+    gint hidden = -1;
+    g_array_append_val (model->row_of, hidden);
+    if (model->filter
+	&& !curve_matches (&g_array_index (model->curves, curve_s, idx),
+			   model->filter))
+      return idx;
+
+    /* bisect for the insertion point, then shift the rows below it */
+    guint lo = 0;
+    guint hi = model->rows->len;
+    while (lo < hi) {
+      guint mid = lo + (hi - lo) / 2;
+      if (compare_rows (&g_array_index (model->rows, guint, mid), &idx,
+			model) < 0)
+	lo = mid + 1;
+      else hi = mid;
+    }
+    row = lo;
+    g_array_insert_val (model->rows, row, idx);
+    for (guint i = row; i < model->rows->len; i++)
+      g_array_index (model->row_of, gint, g_array_index (model->rows, guint, i))
+	= (gint)i;
+  }
+
+  GtkTreeIter iter;
+  set_iter (model, &iter, row);
+  GtkTreePath *path = gtk_tree_path_new_from_indices ((gint)row, -1);
+  gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, &iter);
+  gtk_tree_path_free (path);
+
+  return idx;
+}
+
+guint
+curves_model_get_n_curves (CurvesModel *model)
+{
+  return model->curves->len;
+}
+
+curve_s *
+curves_model_get_curve (CurvesModel *model, guint idx)
+{
+  g_return_val_if_fail (idx < model->curves->len, NULL);
+  return &g_array_index (model->curves, curve_s, idx);
+}
+
+gint
+curves_model_iter_get_index (CurvesModel *model, GtkTreeIter *iter)
+{
+  g_return_val_if_fail (iter->stamp == model->stamp, -1);
+  return (gint)row_to_index (model, iter_row (iter));
+}
+
+gint
+curves_model_get_radio (CurvesModel *model, gint column)
+{
+  g_return_val_if_fail (column == INDEPENDENT_X_RADIO_COLUMN ||
+			column == INDEPENDENT_Z_RADIO_COLUMN, -1);
+  return model->radio[column];
+}
+
+void
+curves_model_set_radio (CurvesModel *model, gint column, gint idx)
+{
+  g_return_if_fail (column == INDEPENDENT_X_RADIO_COLUMN ||
+		    column == INDEPENDENT_Z_RADIO_COLUMN);
+
+  gint old = model->radio[column];
+  if (old == idx) return;
+  model->radio[column] = idx;
+  curves_model_index_changed (model, old);
+  curves_model_index_changed (model, idx);
+}
+
+void
+curves_model_set_filter (CurvesModel *model, const gchar *filter)
+{
+  gchar *folded = (filter && *filter) ? g_utf8_casefold (filter, -1) : NULL;
+  GArray *rows = NULL;
+
+  if (folded) {
+    /* a filter that extends the previous one only needs to rescan the
+       rows that were already visible */
+    GArray *from = (model->filter && strstr (folded, model->filter))
+      ? model->rows : NULL;
+    guint count = from ? from->len : model->curves->len;
+
+    rows = g_array_new (FALSE, FALSE, sizeof (guint));
+    for (guint i = 0; i < count; i++) {
+      guint idx = from ? g_array_index (from, guint, i) : i;
+      if (curve_matches (&g_array_index (model->curves, curve_s, idx),
+			 folded))
+	g_array_append_val (rows, idx);
+    }
+  }
+
+  g_free (model->filter);
+  model->filter = folded;
+  rebuild_rows (model, rows);
+  model->stamp++;
+}
+
+const gchar *
+curves_model_get_filter (CurvesModel *model)
+{
+  return model->filter;
+}
+
+gboolean
+curves_model_prefix_match (CurvesModel *model, guint idx,
+			   const gchar *prefix)
+{
+  g_return_val_if_fail (idx < model->curves->len, FALSE);
+
+  const gchar *key = curve_key (&g_array_index (model->curves, curve_s, idx));
+  const gchar *expression = strchr (key, '\n');
+  gsize len = strlen (prefix);
+  return !strncmp (key, prefix, len)
+    || (expression && !strncmp (expression + 1, prefix, len));
+}
+
+void
+curves_model_resort (CurvesModel *model)
+{
+  GArray *old_row_of = model->row_of ? g_array_ref (model->row_of) : NULL;
+  GArray *rows = NULL;
+
+  if (model->rows) {
+    rows = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+			      model->rows->len);
+    g_array_append_vals (rows, model->rows->data, model->rows->len);
+  }
+  rebuild_rows (model, rows);
+  model->stamp++;
+
+  guint n = n_rows (model);
+  if (n > 0) {
+    gint *new_order = g_new (gint, n);
+    for (guint i = 0; i < n; i++) {
+      guint idx = row_to_index (model, i);
+      new_order[i] = old_row_of
+	? g_array_index (old_row_of, gint, idx) : (gint)idx;
+    }
+    GtkTreePath *path = gtk_tree_path_new ();
+    gtk_tree_model_rows_reordered (GTK_TREE_MODEL (model), path, NULL,
+				   new_order);
+    gtk_tree_path_free (path);
+    g_free (new_order);
+  }
+
+  if (old_row_of) g_array_unref (old_row_of);
+}
+
+static gint
+compare_samples (gconstpointer a, gconstpointer b)
+{
+  return CMP (*(const gint64 *)a, *(const gint64 *)b);
+}
+
+void
+curves_model_record_eval (CurvesModel *model, guint idx,
+			  gint64 elapsed,
+			  gdouble *values, guint64 n_values)
+{
+  g_return_if_fail (idx < model->curves->len);
+
+  curve_s *curve = &g_array_index (model->curves, curve_s, idx);
+  curve_stats_s *stats = &curve->stats;
+
+  if (!stats->samples) stats->samples = g_new0 (gint64, CURVE_SAMPLES);
+  stats->samples[stats->count % CURVE_SAMPLES] = elapsed;
+  stats->count++;
+  stats->last = elapsed;
+  stats->total += elapsed;
+  stats->result_size = n_values;
+  stats->bytes += n_values * sizeof (gdouble);
+
+  gint64 sorted[CURVE_SAMPLES];
+  guint n = MIN (stats->count, CURVE_SAMPLES);
+  memcpy (sorted, stats->samples, n * sizeof (gint64));
+  qsort (sorted, n, sizeof (gint64), compare_samples);
+  stats->p99 = sorted[(n * 99 + 99) / 100 - 1];
+
+  curve_release_values (curve);
+  curve->values = values;
+  curve->n_values = n_values;
+  curve->generation++;
+
+  curves_model_index_changed (model, (gint)idx);
+}
+
+/* for results that didn't come from an evaluation, so no statistics */
+void
+curves_model_set_values (CurvesModel *model, guint idx,
+			 gdouble *values, guint64 n_values)
+{
+  g_return_if_fail (idx < model->curves->len);
+
+  curve_s *curve = &g_array_index (model->curves, curve_s, idx);
+  curve_release_values (curve);
+  curve->values = values;
+  curve->n_values = n_values;
+  curve->generation++;
+}
+
+/* values stay in file, which is held until they are replaced */
+void
+curves_model_set_mapped_values (CurvesModel *model, guint idx,
+				GMappedFile *file,
+				const gdouble *values, guint64 n_values)
+{
+  g_return_if_fail (idx < model->curves->len);
+
+  curve_s *curve = &g_array_index (model->curves, curve_s, idx);
+  curve_release_values (curve);
+  curve->values = (gdouble *)values;
+  curve->n_values = n_values;
+  curve->mapping = g_mapped_file_ref (file);
+  curve->generation++;
+}
+
+void
+curves_model_record_profile (CurvesModel *model, guint idx,
+			     GArray *profile)
+{
+  g_return_if_fail (idx < model->curves->len);
+
+  curve_s *curve = &g_array_index (model->curves, curve_s, idx);
+  if (!curve->profile) curve->profile = eval_profile_new ();
+
+  for (guint i = 0; i < profile->len; i++) {
+    profile_s *entry = &g_array_index (profile, profile_s, i);
+    guint j;
+    for (j = 0; j < curve->profile->len; j++) {
+      profile_s *have = &g_array_index (curve->profile, profile_s, j);
+      if (!strcmp (have->name, entry->name)) {
+	have->calls += entry->calls;
+	have->ms += entry->ms;
+	break;
+      }
+    }
+    if (j == curve->profile->len) {
+      profile_s copy = {.name  = g_strdup (entry->name),
+			.calls = entry->calls,
+			.ms    = entry->ms};
+      g_array_append_val (curve->profile, copy);
+    }
+  }
+}
+
+static void
+append_json_string (GString *json, const gchar *str)
+{
+  g_string_append_c (json, '"');
+  for (; *str; str++) {
+    switch (*str) {
+    case '"':  g_string_append (json, "\\\""); break;
+    case '\\': g_string_append (json, "\\\\"); break;
+    case '\n': g_string_append (json, "\\n");  break;
+    case '\t': g_string_append (json, "\\t");  break;
+    default:
+      if ((guchar)*str < 0x20)
+	g_string_append_printf (json, "\\u%04x", (guint)*str);
+      else g_string_append_c (json, *str);
+      break;
+    }
+  }
+  g_string_append_c (json, '"');
+}
+
+/* µs in, ms out; printf would follow the locale's decimal point */
+static void
+append_json_ms (GString *json, const gchar *key, gdouble us)
+{
+  gchar bfr[G_ASCII_DTOSTR_BUF_SIZE];
+  g_string_append_printf (json, ", \"%s\": %s", key,
+			  g_ascii_formatd (bfr, sizeof (bfr), "%.3f",
+					   us / 1000.0));
+}
+
+gboolean
+curves_model_export_stats (CurvesModel *model,
+			   const gchar *filename,
+			   GError **error)
+{
+  GString *json = g_string_new ("{\n  \"curves\": [");
+
+  for (guint i = 0; i < model->curves->len; i++) {
+    curve_s *curve = &g_array_index (model->curves, curve_s, i);
+    curve_stats_s *stats = &curve->stats;
+
+    g_string_append (json, i ? ",\n    {" : "\n    {");
+    g_string_append (json, "\"label\": ");
+    append_json_string (json, curve->label);
+    g_string_append (json, ", \"expression\": ");
+    append_json_string (json, curve->expression);
+    g_string_append_printf (json, ", \"evaluations\": %u", stats->count);
+    append_json_ms (json, "last_ms",  (gdouble)stats->last);
+    append_json_ms (json, "mean_ms",  curve_mean (curve));
+    append_json_ms (json, "p99_ms",   (gdouble)stats->p99);
+    g_string_append_printf (json,
+			    ", \"result_size\": %" G_GUINT64_FORMAT
+			    ", \"bytes\": %" G_GUINT64_FORMAT,
+			    stats->result_size,
+			    stats->bytes);
+
+    g_string_append (json, ", \"profile\": [");
+    for (guint j = 0; curve->profile && j < curve->profile->len; j++) {
+      profile_s *entry = &g_array_index (curve->profile, profile_s, j);
+      g_string_append (json, j ? ", {\"function\": " : "{\"function\": ");
+      append_json_string (json, entry->name);
+      g_string_append_printf (json,
+			      ", \"calls\": %" G_GUINT64_FORMAT
+			      ", \"ms\": %" G_GINT64_FORMAT "}",
+			      entry->calls, entry->ms);
+    }
+    g_string_append (json, "]}");
+  }
+  g_string_append (json, "\n  ]\n}\n");
+
+  gboolean rc = g_file_set_contents (filename, json->str, json->len, error);
+  g_string_free (json, TRUE);
+  return rc;
+}
@@ -0,0 +1,90 @@
+#ifndef CURVES_MODEL_H
+#define CURVES_MODEL_H
+
+enum
+  {
+   INDEPENDENT_X_RADIO_COLUMN,
+   INDEPENDENT_Z_RADIO_COLUMN,
+   LABEL_COLUMN,
+   EXPRESSION_COLUMN,
+   EVAL_COUNT_COLUMN,
+   LAST_TIME_COLUMN,
+   MEAN_TIME_COLUMN,
+   P99_TIME_COLUMN,
+   RESULT_SIZE_COLUMN,
+   BYTES_COLUMN,
+   N_COLUMNS
+  };
+
+#define CURVE_SAMPLES 128
+
+typedef struct {
+  guint    count;
+  gint64   last;		// µs
+  gint64   total;		// µs
+  gint64   p99;			// µs, over the last CURVE_SAMPLES evaluations
+  gint64  *samples;		// ring of CURVE_SAMPLES, allocated on first use
+  guint64  result_size;		// elements in the last result
+  guint64  bytes;		// result bytes copied out of the interpreter
+} curve_stats_s;
+
+typedef struct {
+  gchar         *label;
+  gchar         *expression;
+  gchar         *key;		// casefolded label + expression, on demand
+  gdouble       *values;	// last result, read only
+  guint64        n_values;
+  GMappedFile   *mapping;	// holds values read in place, else NULL
+  guint          generation;	// bumped whenever values is replaced
+  curve_stats_s  stats;
+  GArray        *profile;	// profile_s, only once sampled
+} curve_s;
+
+#define CURVES_TYPE_MODEL (curves_model_get_type ())
+G_DECLARE_FINAL_TYPE (CurvesModel, curves_model, CURVES, MODEL, GObject)
+
+CurvesModel *curves_model_new ();
+guint	     curves_model_append (CurvesModel *model,
+				  const gchar *label,
+				  const gchar *expression);
+guint	     curves_model_get_n_curves (CurvesModel *model);
+curve_s	    *curves_model_get_curve (CurvesModel *model, guint idx);
+gint	     curves_model_iter_get_index (CurvesModel *model,
+					  GtkTreeIter *iter);
+
+/* The radio columns hold a single curve index each, -1 for none, so
+   changing the selection touches at most two rows. */
+gint	     curves_model_get_radio (CurvesModel *model, gint column);
+void	     curves_model_set_radio (CurvesModel *model, gint column,
+				     gint idx);
+
+/* Changing the filter invalidates every iter without emitting per-row
+   signals; detach the model from its views while calling this. */
+void	     curves_model_set_filter (CurvesModel *model,
+				      const gchar *filter);
+const gchar *curves_model_get_filter (CurvesModel *model);	// casefolded
+
+/* TRUE if the label or expression starts with prefix, which must
+   already be casefolded, so type-ahead agrees with the filter */
+gboolean     curves_model_prefix_match (CurvesModel *model, guint idx,
+					const gchar *prefix);
+
+/* Takes ownership of values.  Rows are not moved until the next
+   curves_model_resort, so a batch of evaluations reorders once. */
+void	     curves_model_record_eval (CurvesModel *model, guint idx,
+				       gint64 elapsed,
+				       gdouble *values, guint64 n_values);
+void	     curves_model_set_values (CurvesModel *model, guint idx,
+				      gdouble *values, guint64 n_values);
+void	     curves_model_set_mapped_values (CurvesModel *model, guint idx,
+					     GMappedFile *file,
+					     const gdouble *values,
+					     guint64 n_values);
+void	     curves_model_record_profile (CurvesModel *model, guint idx,
+					  GArray *profile);
+void	     curves_model_resort (CurvesModel *model);
+gboolean     curves_model_export_stats (CurvesModel *model,
+					const gchar *filename,
+					GError **error);
+
+#endif  // CURVES_MODEL_H
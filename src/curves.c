@@ -25,34 +25,23 @@
 #define _GNU_SOURCE
 #include <gtk/gtk.h>
 #include <glib/gi18n-lib.h>
+#include <string.h>
 
 #include "aplvis.h"
+#include "curves-model.h"
+#include "curves.h"
+#include "eval.h"
 
-static GtkListStore *curves_store = NULL;
+static CurvesModel *curves_store = NULL;
 static GtkWidget *curves_view = NULL;
+static GtkWidget *curves_dialogue = NULL;
 
 enum
   {
-   INDEPENDENT_X_RADIO_COLUMN,
-   INDEPENDENT_Z_RADIO_COLUMN,
-   LABEL_COLUMN,
-   EXPRESSION_COLUMN,
-   N_COLUMNS
+   CURVES_RESPONSE_ADD = 1,
+   CURVES_RESPONSE_EXPORT
   };
 
-enum
-  {
-   CURVES_RESPONSE_ADD = 1
-  };
-
-typedef union {
-  unsigned int ui;
-  struct {
-    short row_selected;
-    short column_nr;
-  } parts_s;
-} radio_u;
-   
 static void
 add_curve ()
 {
@@ -79,54 +68,13 @@ add_curve ()
   gtk_widget_show_all (dialogue);
 
   gint response = gtk_dialog_run (GTK_DIALOG (dialogue));
-  if (response == GTK_RESPONSE_ACCEPT) {
-    GtkTreeIter   iter;
-    gtk_list_store_append (curves_store, &iter);
-    gtk_list_store_set (curves_store, &iter,
-			INDEPENDENT_X_RADIO_COLUMN, FALSE,
-			INDEPENDENT_Z_RADIO_COLUMN, FALSE,
-			LABEL_COLUMN,
-			gtk_entry_get_text (GTK_ENTRY (elbl)),
-			EXPRESSION_COLUMN,
-			gtk_entry_get_text (GTK_ENTRY (expr)),
-			-1);
-  }
+  if (response == GTK_RESPONSE_ACCEPT)
+    curves_model_append (curves_store,
+			 gtk_entry_get_text (GTK_ENTRY (elbl)),
+			 gtk_entry_get_text (GTK_ENTRY (expr)));
   gtk_widget_destroy (dialogue);
 }
 
-static gboolean
-curves_store_radio_clear_foreach (GtkTreeModel *model,
-				  GtkTreePath *path,
-				  GtkTreeIter *iter,
-				  gpointer data)
-{
-  gint which_col = GPOINTER_TO_INT (data);
-  gtk_list_store_set (GTK_LIST_STORE (model), iter,
-		      which_col, FALSE, -1);	      
-		      
-  return FALSE;
-}
-
-static gboolean
-curves_store_radio_foreach (GtkTreeModel *model,
-                            GtkTreePath *path,
-                            GtkTreeIter *iter,
-                            gpointer data)
-{
-  radio_u radio_spec;
-  radio_spec.ui = GPOINTER_TO_INT (data);
-  
-  gint *indices = gtk_tree_path_get_indices (path);
-  
-  gboolean val =
-    (*indices == (gint)radio_spec.parts_s.row_selected) ? TRUE : FALSE;
-  gtk_list_store_set (GTK_LIST_STORE (model), iter,
-		      (gint)radio_spec.parts_s.column_nr, val,
-		      -1);	      
-		      
-  return FALSE;
-}
-
 static void
 radio_toggle (GtkCellRendererToggle *cell_renderer,
 	      gchar                 *path,
@@ -134,151 +82,241 @@ radio_toggle (GtkCellRendererToggle *cell_renderer,
 {
   GtkTreeIter  iter;
   gint which_col = GPOINTER_TO_INT (user_data);
-  gtk_tree_model_get_iter_from_string (GTK_TREE_MODEL (curves_store),
-                                       &iter, path);
-  
-  gint *indices = gtk_tree_path_get_indices (gtk_tree_path_new_from_string (path));
-
-  radio_u radio_spec = {.parts_s.row_selected = *indices,
-			.parts_s.column_nr = which_col};
+  GtkTreePath *tpath = gtk_tree_path_new_from_string (path);
 
-  gtk_tree_model_foreach (GTK_TREE_MODEL (curves_store),
-			  curves_store_radio_foreach,
-			  GINT_TO_POINTER (radio_spec.ui));
+  if (gtk_tree_model_get_iter (GTK_TREE_MODEL (curves_store), &iter, tpath))
+    curves_model_set_radio (curves_store, which_col,
+			    curves_model_iter_get_index (curves_store, &iter));
+  gtk_tree_path_free (tpath);
 }
 
 static void
 radio_clicked (GtkTreeViewColumn *treeviewcolumn,
                gpointer           user_data)
 {
-  gtk_tree_model_foreach (GTK_TREE_MODEL (curves_store),
-			  curves_store_radio_clear_foreach,
-			  user_data);
+  curves_model_set_radio (curves_store, GPOINTER_TO_INT (user_data), -1);
 }
 
-void
-curves_screen ()
+static void
+filter_changed (GtkSearchEntry *entry,
+		gpointer        user_data)
 {
-  if (!curves_store) {
-    curves_store
-      = gtk_list_store_new (N_COLUMNS,
-			    G_TYPE_BOOLEAN,
-			    G_TYPE_BOOLEAN,
-			    G_TYPE_STRING,
-			    G_TYPE_STRING);
-    
-    /***** dummy data ******/
-    GtkTreeIter   iter;
-    gtk_list_store_append (curves_store, &iter);
-    gtk_list_store_set (curves_store, &iter,
-			INDEPENDENT_X_RADIO_COLUMN, FALSE,
-			INDEPENDENT_Z_RADIO_COLUMN, FALSE,
-			LABEL_COLUMN, "label 1",
-			EXPRESSION_COLUMN, "expression 1",
-			-1);
-
-    gtk_list_store_append (curves_store, &iter);
-    gtk_list_store_set (curves_store, &iter,
-			INDEPENDENT_X_RADIO_COLUMN, FALSE,
-			INDEPENDENT_Z_RADIO_COLUMN, FALSE,
-			LABEL_COLUMN, "label 2",
-			EXPRESSION_COLUMN, "expression 2",
-			-1);
-
-    gtk_list_store_append (curves_store, &iter);
-    gtk_list_store_set (curves_store, &iter,
-			INDEPENDENT_X_RADIO_COLUMN, FALSE,
-			INDEPENDENT_Z_RADIO_COLUMN, FALSE,
-			LABEL_COLUMN, "label 3",
-			EXPRESSION_COLUMN, "expression 3",
-			-1);
-  
-    /**** end dummy data ******/
-  }
-
-  curves_view
-    = gtk_tree_view_new_with_model (GTK_TREE_MODEL (curves_store));
-
-  GtkCellRenderer *renderer;
-  GtkTreeViewColumn *column;
-
-
-  /****** x radio *******/
-
-  renderer = gtk_cell_renderer_toggle_new ();
-  g_signal_connect (G_OBJECT (renderer), "toggled",
-		    G_CALLBACK (radio_toggle),
-		    GINT_TO_POINTER (INDEPENDENT_X_RADIO_COLUMN));
-  gtk_cell_renderer_toggle_set_radio (GTK_CELL_RENDERER_TOGGLE (renderer),
-					TRUE);
-  column =
-    gtk_tree_view_column_new_with_attributes (_ ("X axis"),
-					      renderer,
-					      "active",
-					      INDEPENDENT_X_RADIO_COLUMN,
-					      NULL);
-  gtk_tree_view_column_set_clickable (GTK_TREE_VIEW_COLUMN (column), TRUE);
-  g_signal_connect (G_OBJECT (column), "clicked",
-		    G_CALLBACK (radio_clicked),
-		    GINT_TO_POINTER (INDEPENDENT_X_RADIO_COLUMN));
-  gtk_tree_view_append_column (GTK_TREE_VIEW (curves_view), column);
-    
-
-  /****** z radio *******/
+  curves_set_filter (gtk_entry_get_text (GTK_ENTRY (entry)));
+}
 
+static gboolean
+search_equal (GtkTreeModel *model,
+	      gint          column,
+	      const gchar  *key,
+	      GtkTreeIter  *iter,
+	      gpointer      search_data)
+{
+  gchar *folded = g_utf8_casefold (key, -1);
+  gboolean match =
+    curves_model_prefix_match (curves_store,
+			       curves_model_iter_get_index (curves_store, iter),
+			       folded);
+  g_free (folded);
+
+  /* FALSE means the row matches */
+  return !match;
+}
 
-  renderer = gtk_cell_renderer_toggle_new ();
+static GtkTreeViewColumn *
+radio_column (const gchar *title, gint which_col)
+{
+  GtkCellRenderer *renderer = gtk_cell_renderer_toggle_new ();
   g_signal_connect (G_OBJECT (renderer), "toggled",
 		    G_CALLBACK (radio_toggle),
-		    GINT_TO_POINTER (INDEPENDENT_Z_RADIO_COLUMN));
+		    GINT_TO_POINTER (which_col));
   gtk_cell_renderer_toggle_set_radio (GTK_CELL_RENDERER_TOGGLE (renderer),
 				      TRUE);
-  column =
-    gtk_tree_view_column_new_with_attributes (_ ("Z axis"),
+  GtkTreeViewColumn *column =
+    gtk_tree_view_column_new_with_attributes (title,
 					      renderer,
-					      "active",
-					      INDEPENDENT_Z_RADIO_COLUMN,
+					      "active", which_col,
 					      NULL);
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (column, 60);
   gtk_tree_view_column_set_clickable (GTK_TREE_VIEW_COLUMN (column), TRUE);
   g_signal_connect (G_OBJECT (column), "clicked",
 		    G_CALLBACK (radio_clicked),
-		    GINT_TO_POINTER (INDEPENDENT_Z_RADIO_COLUMN));
-  gtk_tree_view_append_column (GTK_TREE_VIEW (curves_view), column);
-
-    /****** label *******/
-    
-  renderer = gtk_cell_renderer_text_new ();
-  column =
-    gtk_tree_view_column_new_with_attributes (_("Label"),
+		    GINT_TO_POINTER (which_col));
+  return column;
+}
+
+static GtkTreeViewColumn *
+text_column (const gchar *title, gint which_col, gint width)
+{
+  GtkCellRenderer *renderer = gtk_cell_renderer_text_new ();
+  g_object_set (G_OBJECT (renderer), "ellipsize", PANGO_ELLIPSIZE_END, NULL);
+  GtkTreeViewColumn *column =
+    gtk_tree_view_column_new_with_attributes (title,
 					      renderer,
-					      "text", LABEL_COLUMN,
+					      "text", which_col,
 					      NULL);
-  gtk_tree_view_append_column (GTK_TREE_VIEW (curves_view), column);
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (column, width);
+  gtk_tree_view_column_set_resizable (column, TRUE);
+  gtk_tree_view_column_set_sort_column_id (column, which_col);
+  return column;
+}
 
-  /****** expression *******/
+static void
+ms_cell_data (GtkTreeViewColumn *column,
+	      GtkCellRenderer   *renderer,
+	      GtkTreeModel      *model,
+	      GtkTreeIter       *iter,
+	      gpointer           user_data)
+{
+  gdouble ms;
+  gchar bfr[32];
+  gtk_tree_model_get (model, iter, GPOINTER_TO_INT (user_data), &ms, -1);
+  g_snprintf (bfr, sizeof (bfr), "%.3f", ms);
+  g_object_set (G_OBJECT (renderer), "text", bfr, NULL);
+}
 
-  renderer = gtk_cell_renderer_text_new ();
-  column =
-    gtk_tree_view_column_new_with_attributes (_("Expression"),
-					      renderer,
-					      "text", EXPRESSION_COLUMN,
-					      NULL);
-  gtk_tree_view_append_column (GTK_TREE_VIEW (curves_view), column);
-  
-  GtkWidget *dialogue
+static GtkTreeViewColumn *
+stat_column (const gchar *title, gint which_col)
+{
+  GtkCellRenderer *renderer = gtk_cell_renderer_text_new ();
+  g_object_set (G_OBJECT (renderer), "xalign", 1.0, NULL);
+  GtkTreeViewColumn *column = gtk_tree_view_column_new ();
+  gtk_tree_view_column_set_title (column, title);
+  gtk_tree_view_column_pack_start (column, renderer, TRUE);
+  if (gtk_tree_model_get_column_type (GTK_TREE_MODEL (curves_store),
+				      which_col) == G_TYPE_DOUBLE)
+    gtk_tree_view_column_set_cell_data_func (column, renderer,
+					     ms_cell_data,
+					     GINT_TO_POINTER (which_col),
+					     NULL);
+  else
+    gtk_tree_view_column_add_attribute (column, renderer, "text", which_col);
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (column, 70);
+  gtk_tree_view_column_set_resizable (column, TRUE);
+  gtk_tree_view_column_set_sort_column_id (column, which_col);
+  return column;
+}
+
+static void
+export_stats ()
+{
+  GtkWidget *chooser =
+    gtk_file_chooser_dialog_new (_ ("Export statistics"),
+				 GTK_WINDOW (curves_dialogue),
+				 GTK_FILE_CHOOSER_ACTION_SAVE,
+				 "_Cancel", GTK_RESPONSE_CANCEL,
+				 "_Save",   GTK_RESPONSE_ACCEPT,
+				 NULL);
+  gtk_file_chooser_set_do_overwrite_confirmation (GTK_FILE_CHOOSER (chooser),
+						  TRUE);
+  gtk_file_chooser_set_current_name (GTK_FILE_CHOOSER (chooser),
+				     "aplvis-stats.json");
+
+  if (gtk_dialog_run (GTK_DIALOG (chooser)) == GTK_RESPONSE_ACCEPT) {
+    GError *error = NULL;
+    gchar *fn = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (chooser));
+    if (!curves_model_export_stats (curves_store, fn, &error)) {
+      GtkWidget *msg =
+	gtk_message_dialog_new (GTK_WINDOW (chooser),
+				GTK_DIALOG_MODAL
+				| GTK_DIALOG_DESTROY_WITH_PARENT,
+				GTK_MESSAGE_ERROR,
+				GTK_BUTTONS_CLOSE,
+				"%s", error->message);
+      gtk_dialog_run (GTK_DIALOG (msg));
+      gtk_widget_destroy (msg);
+      g_error_free (error);
+    }
+    g_free (fn);
+  }
+  gtk_widget_destroy (chooser);
+}
+
+static void
+profile_toggled (GtkToggleButton *button,
+		 gpointer         user_data)
+{
+  eval_set_profiling (gtk_toggle_button_get_active (button));
+}
+
+static void
+build_curves_store ()
+{
+  curves_store = curves_model_new ();
+}
+
+static void
+build_curves_dialogue ()
+{
+  curves_view
+    = gtk_tree_view_new_with_model (GTK_TREE_MODEL (curves_store));
+
+  /* every column is fixed width, so the view only asks the model for the
+     rows actually on screen */
+  gtk_tree_view_append_column (GTK_TREE_VIEW (curves_view),
+			       radio_column (_ ("X axis"),
+					     INDEPENDENT_X_RADIO_COLUMN));
+  gtk_tree_view_append_column (GTK_TREE_VIEW (curves_view),
+			       radio_column (_ ("Z axis"),
+					     INDEPENDENT_Z_RADIO_COLUMN));
+  gtk_tree_view_append_column (GTK_TREE_VIEW (curves_view),
+			       text_column (_ ("Label"),
+					    LABEL_COLUMN, 100));
+  gtk_tree_view_append_column (GTK_TREE_VIEW (curves_view),
+			       text_column (_ ("Expression"),
+					    EXPRESSION_COLUMN, 160));
+  gtk_tree_view_append_column (GTK_TREE_VIEW (curves_view),
+			       stat_column (_ ("Evals"),
+					    EVAL_COUNT_COLUMN));
+  gtk_tree_view_append_column (GTK_TREE_VIEW (curves_view),
+			       stat_column (_ ("Last ms"),
+					    LAST_TIME_COLUMN));
+  gtk_tree_view_append_column (GTK_TREE_VIEW (curves_view),
+			       stat_column (_ ("Mean ms"),
+					    MEAN_TIME_COLUMN));
+  gtk_tree_view_append_column (GTK_TREE_VIEW (curves_view),
+			       stat_column (_ ("P99 ms"),
+					    P99_TIME_COLUMN));
+  gtk_tree_view_append_column (GTK_TREE_VIEW (curves_view),
+			       stat_column (_ ("Size"),
+					    RESULT_SIZE_COLUMN));
+  gtk_tree_view_append_column (GTK_TREE_VIEW (curves_view),
+			       stat_column (_ ("Bytes"),
+					    BYTES_COLUMN));
+  gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (curves_view), TRUE);
+
+  gtk_tree_view_set_enable_search (GTK_TREE_VIEW (curves_view), TRUE);
+  gtk_tree_view_set_search_column (GTK_TREE_VIEW (curves_view),
+				   LABEL_COLUMN);
+  gtk_tree_view_set_search_equal_func (GTK_TREE_VIEW (curves_view),
+				       search_equal, NULL, NULL);
+
+  curves_dialogue
     = gtk_dialog_new_with_buttons (_ ("Expressions"),
 				   GTK_WINDOW (window),
 				   GTK_DIALOG_MODAL
 				   | GTK_DIALOG_DESTROY_WITH_PARENT,
-				   "_Add",   CURVES_RESPONSE_ADD,
-				   "_Close", GTK_RESPONSE_CLOSE,
+				   "_Add",    CURVES_RESPONSE_ADD,
+				   "_Export", CURVES_RESPONSE_EXPORT,
+				   "_Close",  GTK_RESPONSE_CLOSE,
 				   NULL);
-  gtk_widget_set_size_request (dialogue, 400, 200);
-  gtk_window_set_position (GTK_WINDOW (dialogue), GTK_WIN_POS_MOUSE);
-  gtk_dialog_set_default_response (GTK_DIALOG (dialogue),
+  gtk_widget_set_size_request (curves_dialogue, 720, 240);
+  gtk_window_set_position (GTK_WINDOW (curves_dialogue), GTK_WIN_POS_MOUSE);
+  gtk_dialog_set_default_response (GTK_DIALOG (curves_dialogue),
                                    GTK_RESPONSE_CANCEL);
-  GtkWidget *vbox = gtk_dialog_get_content_area (GTK_DIALOG (dialogue));
-  
+  g_signal_connect (curves_dialogue, "destroy",
+		    G_CALLBACK (gtk_widget_destroyed), &curves_dialogue);
+  GtkWidget *vbox =
+    gtk_dialog_get_content_area (GTK_DIALOG (curves_dialogue));
+
+  GtkWidget *filter = gtk_search_entry_new ();
+  gtk_entry_set_placeholder_text (GTK_ENTRY (filter),  _ ("Filter"));
+  g_signal_connect (filter, "search-changed",
+		    G_CALLBACK (filter_changed), NULL);
+  gtk_box_pack_start (GTK_BOX (vbox), GTK_WIDGET (filter), FALSE, FALSE, 4);
+
   GtkWidget *scroll = gtk_scrolled_window_new (NULL, NULL);
   gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scroll),
 				  GTK_POLICY_AUTOMATIC,
@@ -287,16 +325,144 @@ curves_screen ()
 
   gtk_container_add (GTK_CONTAINER (scroll), curves_view);
 
+  GtkWidget *profile =
+    gtk_check_button_new_with_label (_ ("Profile defined functions"));
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (profile),
+				eval_get_profiling ());
+  gtk_widget_set_tooltip_text (profile,
+			       _ ("Profiled runs are not counted in the "
+				  "timing columns"));
+  g_signal_connect (profile, "toggled",
+		    G_CALLBACK (profile_toggled), NULL);
+  gtk_box_pack_start (GTK_BOX (vbox), GTK_WIDGET (profile), FALSE, FALSE, 4);
+}
 
-  gtk_widget_show_all (dialogue);
+void
+curves_screen ()
+{
+  if (!curves_store) build_curves_store ();
+  if (!curves_dialogue) build_curves_dialogue ();
+
+  gtk_widget_show_all (curves_dialogue);
 
   gboolean run = TRUE;
 
   while (run) {
-    gint response = gtk_dialog_run (GTK_DIALOG (dialogue));
+    gint response = gtk_dialog_run (GTK_DIALOG (curves_dialogue));
 
     if (response == CURVES_RESPONSE_ADD) add_curve ();
+    else if (response == CURVES_RESPONSE_EXPORT) export_stats ();
     else run = FALSE;
   }
-  gtk_widget_destroy (dialogue);
+  gtk_widget_hide (curves_dialogue);
+}
+
+GArray *
+curves_evaluate_expressions (gchar **expressions)
+{
+  gboolean profiling = eval_get_profiling ();
+  GArray *results = g_array_new (FALSE, TRUE, sizeof (curves_result_s));
+  for (gchar **expr = expressions; *expr; expr++) {
+    curves_result_s result =
+      {.profile = profiling ? eval_profile_new () : NULL};
+    result.values = eval_expression (*expr, &result.count, &result.elapsed,
+				     result.profile);
+    g_array_append_val (results, result);
+  }
+  return results;
+}
+
+void
+curves_record (gchar **expressions, GArray *results)
+{
+  if (!curves_store) build_curves_store ();
+
+  guint n = curves_model_get_n_curves (curves_store);
+  for (guint i = 0; i < results->len; i++) {
+    curves_result_s *result = &g_array_index (results, curves_result_s, i);
+
+    /* a curve that changed since the copy was taken keeps what it had */
+    if (i >= n
+	|| strcmp (curves_model_get_curve (curves_store, i)->expression,
+		   expressions[i])) {
+      g_free (result->values);
+      if (result->profile) g_array_unref (result->profile);
+      continue;
+    }
+
+    /* the shims inflate elapsed, so profiled runs stay out of the
+       timing statistics */
+    if (result->profile) {
+      curves_model_set_values (curves_store, i, result->values, result->count);
+      curves_model_record_profile (curves_store, i, result->profile);
+      g_array_unref (result->profile);
+    }
+    else curves_model_record_eval (curves_store, i, result->elapsed,
+				   result->values, result->count);
+  }
+  g_array_unref (results);
+
+  if (gtk_tree_sortable_get_sort_column_id (GTK_TREE_SORTABLE (curves_store),
+					    NULL, NULL))
+    curves_model_resort (curves_store);
+}
+
+void
+curves_evaluate ()
+{
+  gint x_idx;
+  gchar **expressions = curves_get_expressions (&x_idx);
+
+  eval_lock ();
+  GArray *results = curves_evaluate_expressions (expressions);
+  eval_unlock ();
+
+  curves_record (expressions, results);
+  g_strfreev (expressions);
+}
+
+guint
+curves_add (const gchar *label, const gchar *expression)
+{
+  if (!curves_store) curves_store = curves_model_new ();
+  return curves_model_append (curves_store, label, expression);
+}
+
+void
+curves_set_filter (const gchar *filter)
+{
+  if (!curves_store) build_curves_store ();
+
+  /* swap the model out so the view doesn't see a row signal per curve */
+  if (curves_view) gtk_tree_view_set_model (GTK_TREE_VIEW (curves_view), NULL);
+  curves_model_set_filter (curves_store, filter);
+  if (curves_view)
+    gtk_tree_view_set_model (GTK_TREE_VIEW (curves_view),
+			     GTK_TREE_MODEL (curves_store));
+}
+
+CurvesModel *
+curves_get_model ()
+{
+  if (!curves_store) build_curves_store ();
+  return curves_store;
+}
+
+gboolean
+curves_empty ()
+{
+  return !curves_store || curves_model_get_n_curves (curves_store) == 0;
+}
+
+gchar **
+curves_get_expressions (gint *x_idx)
+{
+  if (!curves_store) build_curves_store ();
+
+  guint n = curves_model_get_n_curves (curves_store);
+  gchar **exprs = g_new0 (gchar *, n + 1);
+  for (guint i = 0; i < n; i++)
+    exprs[i] = g_strdup (curves_model_get_curve (curves_store, i)->expression);
+  *x_idx = curves_model_get_radio (curves_store, INDEPENDENT_X_RADIO_COLUMN);
+  return exprs;
 }
@@ -1,6 +1,33 @@
 #ifndef CURVES_H
 #define CURVES_H
 
-void curves_screen ();
+typedef struct {
+  gdouble *values;
+  guint64  count;
+  gint64   elapsed;
+  GArray  *profile;		// profile_s, NULL unless profiling
+} curves_result_s;
+
+void	 curves_screen ();
+void	 curves_evaluate ();
+
+/* curves_evaluate in two halves: the first evaluates a copy of the
+   expressions on any thread holding eval_lock, the second hands its
+   GArray of curves_result_s to the model on the main thread */
+GArray	*curves_evaluate_expressions (gchar **expressions);
+void	 curves_record (gchar **expressions, GArray *results);
+
+guint	 curves_add (const gchar *label, const gchar *expression);
+gboolean curves_empty ();
+
+/* filters the model under the Curves dialog's view; other views of it
+   must be detached around the call */
+void	 curves_set_filter (const gchar *filter);
+
+/* creates an empty model if nothing has been added yet */
+CurvesModel *curves_get_model ();
+
+/* NULL-terminated copy, for evaluating away from the model */
+gchar	**curves_get_expressions (gint *x_idx);
 
 #endif  // CURVES_H
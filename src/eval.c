@@ -0,0 +1,363 @@
+/*
+    This file is part of GNU APL, a free implementation of the
+    ISO/IEC Standard 13751, "Programming Language APL, Extended"
+
+    Copyright (C) 2020 Chris Moller
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#define _GNU_SOURCE
+#include <gtk/gtk.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <apl/libapl.h>
+
+#include "eval.h"
+
+static gboolean profiling = FALSE;
+static GMutex	apl_lock;
+
+/*
+  Profiling wraps each defined function F referenced by the expression
+  in a shim, aplvisW_F, which accumulates ⎕AI compute time and a call
+  count into aplvisT_F and aplvisN_F.  Only the expression text is
+  rewritten, so F itself is never touched and calls F makes internally
+  are charged to F.  The shim's locals are prefixed to keep them from
+  shadowing names F might use under dynamic scoping.
+*/
+
+#define WRAP_PFX  "aplvisW_"
+#define TIME_PFX  "aplvisT_"
+#define COUNT_PFX "aplvisN_"
+
+static void
+profile_clear (gpointer data)
+{
+  profile_s *entry = data;
+  g_free (entry->name);
+}
+
+void
+eval_lock ()
+{
+  g_mutex_lock (&apl_lock);
+}
+
+void
+eval_unlock ()
+{
+  g_mutex_unlock (&apl_lock);
+}
+
+void
+eval_init ()
+{
+  init_libapl ("apl", 0);
+}
+
+/* runs an APL command, such as )LOAD, discarding what it prints */
+void
+eval_command (const gchar *command)
+{
+  const char *out = apl_command (command);
+  free ((void *)out);
+}
+
+GArray *
+eval_profile_new ()
+{
+  GArray *profile = g_array_new (FALSE, FALSE, sizeof (profile_s));
+  g_array_set_clear_func (profile, profile_clear);
+  return profile;
+}
+
+void
+eval_set_profiling (gboolean on)
+{
+  profiling = on;
+}
+
+gboolean
+eval_get_profiling ()
+{
+  return profiling;
+}
+
+static gdouble
+value_real (const APL_value val, uint64_t idx)
+{
+  if (is_int (val, idx))   return (gdouble)get_int (val, idx);
+  if (is_float (val, idx)) return (gdouble)get_real (val, idx);
+  return NAN;
+}
+
+/* executes stmt and returns the first element of its result */
+static gdouble
+exec_real (const gchar *stmt)
+{
+  gdouble rc = NAN;
+  APL_value val = apl_exec (stmt);
+  if (val) {
+    if (get_element_count (val) > 0) rc = value_real (val, 0);
+    release_value (val, LOC);
+  }
+  return rc;
+}
+
+static void
+append_quoted (GString *str, const gchar *line)
+{
+  g_string_append_c (str, ' ');
+  g_string_append_c (str, '\'');
+  for (; *line; line++) {
+    if (*line == '\'') g_string_append_c (str, '\'');
+    g_string_append_c (str, *line);
+  }
+  g_string_append_c (str, '\'');
+}
+
+/* returns TRUE if name is a function with a result that now has a shim */
+static gboolean
+wrap_function (const gchar *name)
+{
+  gchar *stmt = g_strdup_printf ("⎕NC '%s'", name);
+  gdouble nc = exec_real (stmt);
+  g_free (stmt);
+  if (nc != 3.0) return FALSE;
+
+  /* result, function valence, operator valence */
+  stmt = g_strdup_printf ("1 ⎕AT '%s'", name);
+  APL_value val = apl_exec (stmt);
+  g_free (stmt);
+  if (!val) return FALSE;
+  gboolean usable = get_element_count (val) == 3
+    && value_real (val, 0) == 1.0
+    && value_real (val, 2) == 0.0;
+  gint valence = usable ? (gint)value_real (val, 1) : -1;
+  release_value (val, LOC);
+  if (!usable) return FALSE;
+
+  gchar *wrap  = g_strconcat (WRAP_PFX,  name, NULL);
+  gchar *tvar  = g_strconcat (TIME_PFX,  name, NULL);
+  gchar *cvar  = g_strconcat (COUNT_PFX, name, NULL);
+  GPtrArray *lines = g_ptr_array_new_with_free_func (g_free);
+
+  switch (valence) {
+  case 0:
+    g_ptr_array_add (lines,
+		     g_strdup_printf ("aplvisZ←%s;aplvisS", wrap));
+    g_ptr_array_add (lines, g_strdup ("aplvisS←⎕AI[⎕IO+1]"));
+    g_ptr_array_add (lines, g_strdup_printf ("aplvisZ←%s", name));
+    break;
+  case 1:
+    g_ptr_array_add (lines,
+		     g_strdup_printf ("aplvisZ←%s aplvisB;aplvisS", wrap));
+    g_ptr_array_add (lines, g_strdup ("aplvisS←⎕AI[⎕IO+1]"));
+    g_ptr_array_add (lines, g_strdup_printf ("aplvisZ←%s aplvisB", name));
+    break;
+  default:		// dyadic or ambivalent
+    g_ptr_array_add (lines,
+		     g_strdup_printf ("aplvisZ←{aplvisA} %s aplvisB;aplvisS",
+				      wrap));
+    g_ptr_array_add (lines, g_strdup ("aplvisS←⎕AI[⎕IO+1]"));
+    g_ptr_array_add (lines, g_strdup ("→(0=⎕NC 'aplvisA')/aplvisM"));
+    g_ptr_array_add (lines,
+		     g_strdup_printf ("aplvisZ←aplvisA %s aplvisB", name));
+    g_ptr_array_add (lines, g_strdup ("→aplvisE"));
+    g_ptr_array_add (lines,
+		     g_strdup_printf ("aplvisM:aplvisZ←%s aplvisB", name));
+    break;
+  }
+  g_ptr_array_add (lines,
+		   g_strdup_printf ("%s%s←%s+⎕AI[⎕IO+1]-aplvisS",
+				    (valence > 1) ? "aplvisE:" : "",
+				    tvar, tvar));
+  g_ptr_array_add (lines, g_strdup_printf ("%s←%s+1", cvar, cvar));
+
+  GString *fx = g_string_new ("⎕FX");
+  for (guint i = 0; i < lines->len; i++)
+    append_quoted (fx, g_ptr_array_index (lines, i));
+
+  /* ⎕FX answers the name on success and a line number on failure */
+  val = apl_exec (fx->str);
+  gboolean fixed = val && get_element_count (val) > 0 && is_char (val, 0);
+  if (val) release_value (val, LOC);
+
+  if (fixed) {
+    stmt = g_strdup_printf ("%s←%s←0", tvar, cvar);
+    val = apl_exec (stmt);
+    if (val) release_value (val, LOC);
+    g_free (stmt);
+  }
+
+  g_string_free (fx, TRUE);
+  g_ptr_array_unref (lines);
+  g_free (wrap);
+  g_free (tvar);
+  g_free (cvar);
+  return fixed;
+}
+
+/* returns the byte length of the name character at p, 0 if there isn't one */
+static gsize
+name_char (const gchar *p, gboolean first)
+{
+  if (g_ascii_isalpha (*p) || *p == '_') return 1;
+  if (!first && g_ascii_isdigit (*p))    return 1;
+  if (g_str_has_prefix (p, "∆") || g_str_has_prefix (p, "⍙"))
+    return strlen ("∆");
+  if (!first && g_str_has_prefix (p, "¯")) return strlen ("¯");
+  return 0;
+}
+
+/* rewrites expression to call shims, collecting the wrapped names */
+static gchar *
+profile_rewrite (const gchar *expression, GPtrArray *wrapped)
+{
+  GHashTable *seen = g_hash_table_new_full (g_str_hash, g_str_equal,
+					    g_free, NULL);
+  GString *out = g_string_new (NULL);
+  const gchar *p = expression;
+
+  while (*p) {
+    gsize len;
+    if (*p == '\'') {
+      const gchar *q = p + 1;
+      while (*q && !(*q == '\'' && q[1] != '\'')) q += (*q == '\'') ? 2 : 1;
+      if (*q) q++;
+      g_string_append_len (out, p, q - p);
+      p = q;
+    }
+    else if (g_str_has_prefix (p, "⍝")) {
+      g_string_append (out, p);
+      break;
+    }
+    else if (g_str_has_prefix (p, "⎕")) {	// system name, leave it be
+      const gchar *q = p + strlen ("⎕");
+      while ((len = name_char (q, FALSE))) q += len;
+      g_string_append_len (out, p, q - p);
+      p = q;
+    }
+    else if (name_char (p, TRUE)) {
+      const gchar *q = p;
+      while ((len = name_char (q, q == p))) q += len;
+      gchar *name = g_strndup (p, q - p);
+      gpointer state = g_hash_table_lookup (seen, name);
+      if (!state) {
+	state = GINT_TO_POINTER (wrap_function (name) ? 1 : 2);
+	if (state == GINT_TO_POINTER (1))
+	  g_ptr_array_add (wrapped, g_strdup (name));
+	g_hash_table_insert (seen, g_strdup (name), state);
+      }
+      if (state == GINT_TO_POINTER (1)) g_string_append (out, WRAP_PFX);
+      g_string_append (out, name);
+      g_free (name);
+      p = q;
+    }
+    else g_string_append_c (out, *p++);
+  }
+
+  g_hash_table_unref (seen);
+  return g_string_free (out, FALSE);
+}
+
+static void
+profile_collect (GPtrArray *wrapped, GArray *profile)
+{
+  for (guint i = 0; i < wrapped->len; i++) {
+    const gchar *name = g_ptr_array_index (wrapped, i);
+    gchar *stmt = g_strconcat (COUNT_PFX, name, NULL);
+    gdouble calls = exec_real (stmt);
+    g_free (stmt);
+    stmt = g_strconcat (TIME_PFX, name, NULL);
+    gdouble ms = exec_real (stmt);
+    g_free (stmt);
+
+    if (calls > 0.0) {
+      profile_s entry = {.name  = g_strdup (name),
+			 .calls = (guint64)calls,
+			 .ms    = isnan (ms) ? 0 : (gint64)ms};
+      g_array_append_val (profile, entry);
+    }
+
+    stmt = g_strdup_printf ("⎕EX ⊃'%s%s' '%s%s' '%s%s'",
+			    WRAP_PFX, name, TIME_PFX, name, COUNT_PFX, name);
+    APL_value val = apl_exec (stmt);
+    if (val) release_value (val, LOC);
+    g_free (stmt);
+  }
+}
+
+gdouble *
+eval_expression (const gchar *expression, guint64 *count,
+		 gint64 *elapsed, GArray *profile)
+{
+  GPtrArray *wrapped = NULL;
+  gchar *stmt = NULL;
+
+  if (profile) {
+    wrapped = g_ptr_array_new_with_free_func (g_free);
+    stmt = profile_rewrite (expression, wrapped);
+  }
+
+  gdouble *values = NULL;
+  *count = 0;
+  gint64 start = g_get_monotonic_time ();
+  APL_value val = apl_exec (stmt ? stmt : expression);
+  if (val) {
+    guint64 n = get_element_count (val);
+    values = g_new (gdouble, n ? n : 1);
+    for (guint64 i = 0; i < n; i++) values[i] = value_real (val, i);
+    *count = n;
+    release_value (val, LOC);
+  }
+  *elapsed = g_get_monotonic_time () - start;
+
+  if (wrapped) {
+    profile_collect (wrapped, profile);
+    g_ptr_array_unref (wrapped);
+  }
+  g_free (stmt);
+
+  return values;
+}
+
+void
+eval_set_variable (const gchar *name, gdouble value)
+{
+  g_return_if_fail (isfinite (value));
+
+  gchar bfr[G_ASCII_DTOSTR_BUF_SIZE];
+  g_ascii_formatd (bfr, sizeof (bfr), "%.17g", value);
+
+  /* APL spells the negative sign ¯ and wants an upper case exponent
+     with no + sign */
+  GString *stmt = g_string_new (name);
+  g_string_append (stmt, "←");
+  for (const gchar *p = bfr; *p; p++) {
+    if (*p == '-') g_string_append (stmt, "¯");
+    else if (*p != '+') g_string_append_c (stmt, (*p == 'e') ? 'E' : *p);
+  }
+
+  APL_value val = apl_exec (stmt->str);
+  if (val) release_value (val, LOC);
+  g_string_free (stmt, TRUE);
+}
@@ -0,0 +1,33 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+typedef struct {
+  gchar   *name;		// defined function
+  guint64  calls;
+  gint64   ms;			// ⎕AI compute time, inclusive
+} profile_s;
+
+/* libapl isn't reentrant; hold this around any sequence of calls that
+   might run while another thread is evaluating */
+void	  eval_lock ();
+void	  eval_unlock ();
+
+void	  eval_init ();
+void	  eval_command (const gchar *command);
+
+GArray	 *eval_profile_new ();
+void	  eval_set_profiling (gboolean on);
+gboolean  eval_get_profiling ();
+
+/* Evaluates expression and returns its elements as doubles, NULL on
+   an APL error.  elapsed covers the interpreter call and the copy
+   out.  If profile is non-NULL every defined function the expression
+   calls is timed and appended to it; elapsed then includes the
+   timing shims. */
+gdouble	 *eval_expression (const gchar *expression, guint64 *count,
+			   gint64 *elapsed, GArray *profile);
+
+/* value must be finite; APL has no spelling for inf or nan */
+void	  eval_set_variable (const gchar *name, gdouble value);
+
+#endif  // EVAL_H
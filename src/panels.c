@@ -0,0 +1,762 @@
+/*
+    This file is part of GNU APL, a free implementation of the
+    ISO/IEC Standard 13751, "Programming Language APL, Extended"
+
+    Copyright (C) 2020 Chris Moller
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#define _GNU_SOURCE
+#include <gtk/gtk.h>
+#include <glib/gi18n-lib.h>
+#include <string.h>
+
+#include "aplvis.h"
+#include "render.h"
+#include "curves-model.h"
+#include "curves.h"
+#include "panels.h"
+
+#define PANEL_X_CURVES	-2	// whatever the Curves dialog selects
+#define PANEL_X_INDEX	-1
+
+#define GRIDS_MAX	32
+
+typedef struct {
+  guchar *pixels;
+  gint    width;
+  gint    height;
+} raster_s;
+
+typedef struct {
+  GtkWidget  *area;		// NULL while outside the layout
+  GByteArray *shown;		// a byte per curve, NULL for every curve
+  gint        x_idx;
+  gboolean    fixed_range;
+  gdouble     range[4];		// xmin, xmax, ymin, ymax
+  raster_s    front;		// last finished render
+  raster_s    back;		// owned by the pool while busy
+  guint64     key;		// inputs of front, 0 for none
+  gboolean    busy;
+} panel_s;
+
+typedef struct {
+  panel_s       *panel;
+  guint64        key;
+  gchar         *title;
+  render_grid_s *grid;
+  GArray        *ys;		// series_s
+  gboolean       fixed_range;
+  gdouble        yrange[2];
+} task_s;
+
+typedef struct {
+  gint           x_idx;
+  guint          generation;
+  guint64        n;		// index axis length, 0 for a curve
+  gint           width;
+  gboolean       fixed_range;
+  gdouble        xrange[2];
+  render_grid_s *grid;
+} grid_entry_s;
+
+/* panels are never freed, so a render finishing after its panel left
+   the layout still has somewhere to land */
+static panel_s      panels[PANELS_MAX];
+static gint         n_panels = 1;
+static gint         base_width;
+static gint         base_height;
+static GtkWidget   *panels_grid;
+static GThreadPool *pool;
+static GMutex       pool_lock;
+static GCond        pool_idle;
+static guint        pool_running;	// pushed and not yet rendered
+static GArray      *grids;		// grid_entry_s
+
+
+/****** inputs *****/
+
+static gint
+panel_x_idx (panel_s *panel, CurvesModel *model)
+{
+  gint x_idx = panel->x_idx;
+  if (x_idx == PANEL_X_CURVES)
+    x_idx = curves_model_get_radio (model, INDEPENDENT_X_RADIO_COLUMN);
+  if (x_idx >= (gint)curves_model_get_n_curves (model)) x_idx = PANEL_X_INDEX;
+  return x_idx < 0 ? PANEL_X_INDEX : x_idx;
+}
+
+static gboolean
+panel_shows (panel_s *panel, guint idx)
+{
+  /* curves added since the subset was picked aren't in it */
+  return !panel->shown
+    || (idx < panel->shown->len && panel->shown->data[idx]);
+}
+
+static guint64
+key_mix (guint64 key, guint64 v)	// FNV-1a, a byte at a time
+{
+  for (guint i = 0; i < 8; i++) {
+    key ^= (v >> (8 * i)) & 0xff;
+    key *= 0x100000001b3ULL;
+  }
+  return key;
+}
+
+static guint64
+key_mix_double (guint64 key, gdouble v)
+{
+  guint64 bits;
+  memcpy (&bits, &v, sizeof (bits));
+  return key_mix (key, bits);
+}
+
+/* everything a render depends on; equal keys draw the same pixels */
+static guint64
+panel_key (panel_s *panel, gint width, gint height)
+{
+  CurvesModel *model = curves_get_model ();
+  guint n = curves_model_get_n_curves (model);
+  gint x_idx = panel_x_idx (panel, model);
+
+  guint64 key = 0xcbf29ce484222325ULL;
+  key = key_mix (key, (guint64)width);
+  key = key_mix (key, (guint64)height);
+  key = key_mix (key, (guint64)(gint64)x_idx);
+  if (x_idx >= 0)
+    key = key_mix (key, curves_model_get_curve (model, x_idx)->generation);
+  key = key_mix (key, (guint64)panel->fixed_range);
+  if (panel->fixed_range)
+    for (guint i = 0; i < 4; i++) key = key_mix_double (key, panel->range[i]);
+  key = key_mix (key, g_str_hash (gtk_entry_get_text (GTK_ENTRY (title))));
+
+  for (guint i = 0; i < n; i++) {
+    if ((gint)i == x_idx || !panel_shows (panel, i)) continue;
+    key = key_mix (key, (guint64)i);
+    key = key_mix (key, curves_model_get_curve (model, i)->generation);
+  }
+  return key ? key : 1;
+}
+
+
+/****** sample grids *****/
+
+static void
+grids_clear ()
+{
+  if (!grids) return;
+  for (guint i = 0; i < grids->len; i++)
+    render_grid_unref (g_array_index (grids, grid_entry_s, i).grid);
+  g_array_set_size (grids, 0);
+}
+
+/* panels with the same x axis, width and x range share a grid */
+static render_grid_s *
+grid_lookup (panel_s *panel, gint x_idx, const series_s *x, guint64 n,
+	     gint width)
+{
+  CurvesModel *model = curves_get_model ();
+  grid_entry_s want = {.x_idx	    = x_idx,
+		       .generation  = x_idx >= 0
+		       ? curves_model_get_curve (model, x_idx)->generation : 0,
+		       .n	    = x->values ? 0 : n,
+		       .width	    = width,
+		       .fixed_range = panel->fixed_range,
+		       .xrange	    = {panel->range[0], panel->range[1]}};
+  if (!want.fixed_range) want.xrange[0] = want.xrange[1] = 0.0;
+
+  if (!grids) grids = g_array_new (FALSE, FALSE, sizeof (grid_entry_s));
+  for (guint i = 0; i < grids->len; i++) {
+    grid_entry_s *entry = &g_array_index (grids, grid_entry_s, i);
+    if (entry->x_idx == want.x_idx
+	&& entry->generation == want.generation
+	&& entry->n == want.n
+	&& entry->width == want.width
+	&& entry->fixed_range == want.fixed_range
+	&& entry->xrange[0] == want.xrange[0]
+	&& entry->xrange[1] == want.xrange[1])
+      return render_grid_ref (entry->grid);
+  }
+
+  if (grids->len >= GRIDS_MAX) grids_clear ();
+  want.grid = render_grid_new (x, n, width,
+			       want.fixed_range ? want.xrange : NULL);
+  g_array_append_val (grids, want);
+  return render_grid_ref (want.grid);
+}
+
+
+/****** rendering *****/
+
+static gboolean
+panel_rendered (gpointer data)
+{
+  task_s *task = data;
+  panel_s *panel = task->panel;
+
+  raster_s done = panel->back;
+  panel->back = panel->front;
+  panel->front = done;
+  panel->key = task->key;
+  panel->busy = FALSE;
+
+  /* the draw handler starts the next render if anything moved on */
+  if (panel->area) gtk_widget_queue_draw (panel->area);
+
+  render_grid_unref (task->grid);
+  g_array_unref (task->ys);
+  g_free (task->title);
+  g_free (task);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+panel_render (gpointer data, gpointer user_data)
+{
+  task_s *task = data;
+  raster_s *back = &task->panel->back;
+
+  render_plot_grid (back->pixels, back->width, back->height,
+		    task->title, task->grid,
+		    (series_s *)task->ys->data, task->ys->len,
+		    task->fixed_range ? task->yrange : NULL);
+
+  g_mutex_lock (&pool_lock);
+  if (--pool_running == 0) g_cond_broadcast (&pool_idle);
+  g_mutex_unlock (&pool_lock);
+
+  g_idle_add (panel_rendered, task);
+}
+
+static void
+panel_submit (panel_s *panel, guint64 key, gint width, gint height)
+{
+  if (panel->busy) return;		// panel_rendered looks again
+
+  if (panel->back.width != width || panel->back.height != height) {
+    g_free (panel->back.pixels);
+    panel->back.pixels = g_malloc (4 * (gsize)width * (gsize)height);
+    panel->back.width = width;
+    panel->back.height = height;
+  }
+
+  CurvesModel *model = curves_get_model ();
+  guint n = curves_model_get_n_curves (model);
+  gint x_idx = panel_x_idx (panel, model);
+
+  task_s *task = g_new0 (task_s, 1);
+  task->panel = panel;
+  task->key = key;
+  task->title = g_strdup (gtk_entry_get_text (GTK_ENTRY (title)));
+  task->ys = g_array_new (FALSE, FALSE, sizeof (series_s));
+  task->fixed_range = panel->fixed_range;
+  task->yrange[0] = panel->range[2];
+  task->yrange[1] = panel->range[3];
+
+  series_s x = {NULL, 0};
+  guint64 n_max = 0;
+  for (guint i = 0; i < n; i++) {
+    curve_s *curve = curves_model_get_curve (model, i);
+    series_s series = {.values = curve->values, .n_values = curve->n_values};
+    if ((gint)i == x_idx) x = series;
+    else if (panel_shows (panel, i)) {
+      g_array_append_val (task->ys, series);
+      if (series.values && series.n_values > n_max) n_max = series.n_values;
+    }
+  }
+  task->grid = grid_lookup (panel, x_idx, &x, n_max, width);
+
+  if (!pool)
+    pool = g_thread_pool_new (panel_render, NULL,
+			      (gint)MIN (g_get_num_processors (), PANELS_MAX),
+			      FALSE, NULL);
+  panel->busy = TRUE;
+  g_mutex_lock (&pool_lock);
+  pool_running++;
+  g_mutex_unlock (&pool_lock);
+  g_thread_pool_push (pool, task, NULL);
+}
+
+gboolean
+panels_draw (gint idx, cairo_t *cr)
+{
+  panel_s *panel = &panels[idx];
+  gint width = gtk_widget_get_allocated_width (panel->area);
+  gint height = gtk_widget_get_allocated_height (panel->area);
+  if (width <= 0 || height <= 0) return FALSE;
+
+  guint64 key = panel_key (panel, width, height);
+  if (key != panel->key) panel_submit (panel, key, width, height);
+
+  if (panel->front.pixels) {
+    cairo_surface_t *surface =
+      cairo_image_surface_create_for_data (panel->front.pixels,
+					   CAIRO_FORMAT_ARGB32,
+					   panel->front.width,
+					   panel->front.height,
+					   4 * panel->front.width);
+    cairo_set_source_rgb (cr, 1.0, 1.0, 1.0);
+    cairo_paint (cr);
+    cairo_set_source_surface (cr, surface, 0, 0);
+    cairo_paint (cr);
+    cairo_surface_destroy (surface);
+  }
+  else {
+    cairo_set_source_rgb (cr, 1.0, 1.0, 1.0);
+    cairo_paint (cr);
+  }
+
+  return key == panel->key;
+}
+
+void
+panels_refresh ()
+{
+  for (gint i = 0; i < n_panels; i++) {
+    panel_s *panel = &panels[i];
+    if (!panel->area) continue;
+    gint width = gtk_widget_get_allocated_width (panel->area);
+    gint height = gtk_widget_get_allocated_height (panel->area);
+    if (panel_key (panel, width, height) != panel->key)
+      gtk_widget_queue_draw (panel->area);
+  }
+}
+
+void
+panels_sync ()
+{
+  g_mutex_lock (&pool_lock);
+  while (pool_running) g_cond_wait (&pool_idle, &pool_lock);
+  g_mutex_unlock (&pool_lock);
+
+  /* the values the grids point into are about to go */
+  grids_clear ();
+}
+
+const guchar *
+panels_get_pixels (gint idx, gint *width, gint *height)
+{
+  panel_s *panel = &panels[idx];
+  *width = panel->front.width;
+  *height = panel->front.height;
+  return panel->front.pixels;
+}
+
+void
+panels_get_plot (gint idx, panel_plot_s *plot)
+{
+  panel_s *panel = &panels[idx];
+  CurvesModel *model = curves_get_model ();
+  guint n = curves_model_get_n_curves (model);
+  gint x_idx = panel_x_idx (panel, model);
+
+  GPtrArray *exprs = g_ptr_array_new ();
+  plot->x_idx = -1;
+  for (guint i = 0; i < n; i++) {
+    if ((gint)i == x_idx) plot->x_idx = (gint)exprs->len;
+    else if (!panel_shows (panel, i)) continue;
+    g_ptr_array_add (exprs,
+		     g_strdup (curves_model_get_curve (model, i)->expression));
+  }
+  g_ptr_array_add (exprs, NULL);
+  plot->exprs = (gchar **)g_ptr_array_free (exprs, FALSE);
+  plot->fixed_range = panel->fixed_range;
+  memcpy (plot->range, panel->range, sizeof (plot->range));
+}
+
+void
+panels_plot_clear (panel_plot_s *plot)
+{
+  g_clear_pointer (&plot->exprs, g_strfreev);
+}
+
+
+/****** panel settings *****/
+
+static void
+fixed_toggled_cb (GtkToggleButton *button,
+		  gpointer         user_data)
+{
+  gtk_widget_set_sensitive (GTK_WIDGET (user_data),
+			    gtk_toggle_button_get_active (button));
+}
+
+/* the dialogue keeps a byte per curve, not a widget, and lists them
+   in a fixed-height view over the curves model */
+enum
+  {
+   X_MODE_CURVES,
+   X_MODE_INDEX,
+   X_MODE_CURVE
+  };
+
+typedef struct {
+  GtkWidget *view;
+  GtkWidget *x_mode;
+  guint8    *shown;		// per curve
+  gint       x_curve;		// for X_MODE_CURVE, -1 until one is picked
+} picker_s;
+
+static gint
+picker_index (GtkTreeModel *model, GtkTreeIter *iter)
+{
+  return curves_model_iter_get_index (CURVES_MODEL (model), iter);
+}
+
+static gint
+picker_path_index (picker_s *picker, const gchar *path)
+{
+  GtkTreeModel *model = gtk_tree_view_get_model (GTK_TREE_VIEW (picker->view));
+  GtkTreeIter iter;
+  if (!model || !gtk_tree_model_get_iter_from_string (model, &iter, path))
+    return -1;
+  return picker_index (model, &iter);
+}
+
+static void
+x_cell_data (GtkTreeViewColumn *column,
+	     GtkCellRenderer   *renderer,
+	     GtkTreeModel      *model,
+	     GtkTreeIter       *iter,
+	     gpointer           user_data)
+{
+  picker_s *picker = user_data;
+  gboolean active =
+    gtk_combo_box_get_active (GTK_COMBO_BOX (picker->x_mode)) == X_MODE_CURVE
+    && picker_index (model, iter) == picker->x_curve;
+  gtk_cell_renderer_toggle_set_active (GTK_CELL_RENDERER_TOGGLE (renderer),
+				       active);
+}
+
+static void
+shown_cell_data (GtkTreeViewColumn *column,
+		 GtkCellRenderer   *renderer,
+		 GtkTreeModel      *model,
+		 GtkTreeIter       *iter,
+		 gpointer           user_data)
+{
+  picker_s *picker = user_data;
+  gint idx = picker_index (model, iter);
+  gtk_cell_renderer_toggle_set_active (GTK_CELL_RENDERER_TOGGLE (renderer),
+				       picker->shown[idx]);
+}
+
+static void
+x_toggled_cb (GtkCellRendererToggle *renderer,
+	      gchar                 *path,
+	      gpointer               user_data)
+{
+  picker_s *picker = user_data;
+  gint idx = picker_path_index (picker, path);
+  if (idx < 0) return;
+  picker->x_curve = idx;
+  gtk_combo_box_set_active (GTK_COMBO_BOX (picker->x_mode), X_MODE_CURVE);
+  gtk_widget_queue_draw (picker->view);
+}
+
+static void
+shown_toggled_cb (GtkCellRendererToggle *renderer,
+		  gchar                 *path,
+		  gpointer               user_data)
+{
+  picker_s *picker = user_data;
+  gint idx = picker_path_index (picker, path);
+  if (idx < 0) return;
+  picker->shown[idx] = !picker->shown[idx];
+  gtk_widget_queue_draw (picker->view);
+}
+
+static void
+x_mode_changed_cb (GtkComboBox *combo,
+		   gpointer     user_data)
+{
+  picker_s *picker = user_data;
+  gtk_widget_queue_draw (picker->view);
+}
+
+static void
+picker_filter_cb (GtkSearchEntry *entry,
+		  gpointer        user_data)
+{
+  picker_s *picker = user_data;
+
+  /* as in the Curves dialog, no row signal per curve */
+  gtk_tree_view_set_model (GTK_TREE_VIEW (picker->view), NULL);
+  curves_set_filter (gtk_entry_get_text (GTK_ENTRY (entry)));
+  gtk_tree_view_set_model (GTK_TREE_VIEW (picker->view),
+			   GTK_TREE_MODEL (curves_get_model ()));
+}
+
+static GtkTreeViewColumn *
+picker_toggle_column (picker_s *picker, const gchar *title, gboolean radio,
+		      GtkTreeCellDataFunc cell_data, GCallback toggled)
+{
+  GtkCellRenderer *renderer = gtk_cell_renderer_toggle_new ();
+  gtk_cell_renderer_toggle_set_radio (GTK_CELL_RENDERER_TOGGLE (renderer),
+				      radio);
+  g_signal_connect (renderer, "toggled", toggled, picker);
+  GtkTreeViewColumn *column =
+    gtk_tree_view_column_new_with_attributes (title, renderer, NULL);
+  gtk_tree_view_column_set_cell_data_func (column, renderer,
+					   cell_data, picker, NULL);
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (column, 50);
+  return column;
+}
+
+static GtkTreeViewColumn *
+picker_text_column (const gchar *title, gint which_col, gint width)
+{
+  GtkCellRenderer *renderer = gtk_cell_renderer_text_new ();
+  g_object_set (G_OBJECT (renderer), "ellipsize", PANGO_ELLIPSIZE_END, NULL);
+  GtkTreeViewColumn *column =
+    gtk_tree_view_column_new_with_attributes (title, renderer,
+					      "text", which_col, NULL);
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (column, width);
+  gtk_tree_view_column_set_resizable (column, TRUE);
+  return column;
+}
+
+static void
+panel_dialogue (gint idx)
+{
+  panel_s *panel = &panels[idx];
+  CurvesModel *model = curves_get_model ();
+  guint n = curves_model_get_n_curves (model);
+  gchar *saved_filter = g_strdup (curves_model_get_filter (model));
+
+  picker_s picker = {.shown   = g_malloc0 (n ? n : 1),
+		     .x_curve = (panel->x_idx >= 0 && panel->x_idx < (gint)n)
+		     ? panel->x_idx : -1};
+  if (panel->shown)
+    memcpy (picker.shown, panel->shown->data, MIN (n, panel->shown->len));
+  else memset (picker.shown, TRUE, n);
+
+  gchar *heading = g_strdup_printf (_ ("Panel %d"), idx + 1);
+  GtkWidget *dialogue
+    = gtk_dialog_new_with_buttons (heading,
+				   GTK_WINDOW (window),
+				   GTK_DIALOG_MODAL
+				   | GTK_DIALOG_DESTROY_WITH_PARENT,
+				   "_OK", GTK_RESPONSE_ACCEPT,
+				   "_Cancel", GTK_RESPONSE_CANCEL,
+				   NULL);
+  g_free (heading);
+  gtk_window_set_position (GTK_WINDOW (dialogue), GTK_WIN_POS_MOUSE);
+  gtk_dialog_set_default_response (GTK_DIALOG (dialogue),
+				   GTK_RESPONSE_ACCEPT);
+  GtkWidget *vbox = gtk_dialog_get_content_area (GTK_DIALOG (dialogue));
+
+  /************* x axis **********/
+
+  picker.x_mode = gtk_combo_box_text_new ();
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (picker.x_mode),
+				  _ ("As in Curves"));
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (picker.x_mode),
+				  _ ("Index"));
+  gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (picker.x_mode),
+				  _ ("Curve marked below"));
+  gtk_combo_box_set_active (GTK_COMBO_BOX (picker.x_mode),
+			    picker.x_curve >= 0 ? X_MODE_CURVE
+			    : panel->x_idx == PANEL_X_INDEX ? X_MODE_INDEX
+			    : X_MODE_CURVES);
+  g_signal_connect (picker.x_mode, "changed",
+		    G_CALLBACK (x_mode_changed_cb), &picker);
+  GtkWidget *frame = gtk_frame_new (_ ("X axis"));
+  gtk_container_add (GTK_CONTAINER (frame), picker.x_mode);
+  gtk_box_pack_start (GTK_BOX (vbox), frame, FALSE, FALSE, 2);
+
+  /************* curves **********/
+
+  GtkWidget *search = gtk_search_entry_new ();
+  if (saved_filter) gtk_entry_set_text (GTK_ENTRY (search), saved_filter);
+  g_signal_connect (search, "search-changed",
+		    G_CALLBACK (picker_filter_cb), &picker);
+
+  picker.view = gtk_tree_view_new_with_model (GTK_TREE_MODEL (model));
+  gtk_tree_view_append_column (GTK_TREE_VIEW (picker.view),
+			       picker_toggle_column (&picker, _ ("X"), TRUE,
+						     x_cell_data,
+						     G_CALLBACK (x_toggled_cb)));
+  gtk_tree_view_append_column (GTK_TREE_VIEW (picker.view),
+			       picker_toggle_column (&picker, _ ("Shown"),
+						     FALSE, shown_cell_data,
+						     G_CALLBACK
+						     (shown_toggled_cb)));
+  gtk_tree_view_append_column (GTK_TREE_VIEW (picker.view),
+			       picker_text_column (_ ("Label"),
+						   LABEL_COLUMN, 100));
+  gtk_tree_view_append_column (GTK_TREE_VIEW (picker.view),
+			       picker_text_column (_ ("Expression"),
+						   EXPRESSION_COLUMN, 160));
+  gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (picker.view), TRUE);
+  gtk_tree_view_set_enable_search (GTK_TREE_VIEW (picker.view), FALSE);
+
+  GtkWidget *scroll = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scroll),
+				  GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+  gtk_widget_set_size_request (scroll, 380, 200);
+  gtk_container_add (GTK_CONTAINER (scroll), picker.view);
+
+  GtkWidget *curves_box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 2);
+  gtk_box_pack_start (GTK_BOX (curves_box), search, FALSE, FALSE, 0);
+  gtk_box_pack_start (GTK_BOX (curves_box), scroll, TRUE, TRUE, 0);
+  frame = gtk_frame_new (_ ("Curves"));
+  gtk_container_add (GTK_CONTAINER (frame), curves_box);
+  gtk_box_pack_start (GTK_BOX (vbox), frame, TRUE, TRUE, 2);
+
+  /************* ranges **********/
+
+  static const gchar *range_labels[4] =
+    {N_ ("X from"), N_ ("X to"), N_ ("Y from"), N_ ("Y to")};
+  GtkWidget *range_spins[4];
+  GtkWidget *grid = gtk_grid_new ();
+  for (gint i = 0; i < 4; i++) {
+    range_spins[i] =
+      gtk_spin_button_new_with_range (-G_MAXFLOAT, G_MAXFLOAT, 0.1);
+    gtk_spin_button_set_digits (GTK_SPIN_BUTTON (range_spins[i]), 3);
+    gtk_spin_button_set_value (GTK_SPIN_BUTTON (range_spins[i]),
+			       panel->range[i]);
+    gtk_grid_attach (GTK_GRID (grid), gtk_label_new (_ (range_labels[i])),
+		     0, i, 1, 1);
+    gtk_grid_attach (GTK_GRID (grid), range_spins[i], 1, i, 1, 1);
+  }
+  GtkWidget *fixed = gtk_check_button_new_with_label (_ ("Fixed ranges"));
+  g_signal_connect (fixed, "toggled", G_CALLBACK (fixed_toggled_cb), grid);
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (fixed),
+				panel->fixed_range);
+  gtk_widget_set_sensitive (grid, panel->fixed_range);
+  GtkWidget *range_box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 2);
+  gtk_box_pack_start (GTK_BOX (range_box), fixed, FALSE, FALSE, 0);
+  gtk_box_pack_start (GTK_BOX (range_box), grid, FALSE, FALSE, 0);
+  frame = gtk_frame_new (_ ("Ranges"));
+  gtk_container_add (GTK_CONTAINER (frame), range_box);
+  gtk_box_pack_start (GTK_BOX (vbox), frame, FALSE, FALSE, 2);
+
+  gtk_widget_show_all (dialogue);
+  if (gtk_dialog_run (GTK_DIALOG (dialogue)) == GTK_RESPONSE_ACCEPT) {
+    gint mode = gtk_combo_box_get_active (GTK_COMBO_BOX (picker.x_mode));
+    panel->x_idx = (mode == X_MODE_INDEX) ? PANEL_X_INDEX
+      : (mode == X_MODE_CURVE && picker.x_curve >= 0) ? picker.x_curve
+      : PANEL_X_CURVES;
+
+    /* with every curve ticked, curves added later show up too */
+    if (panel->shown) g_byte_array_unref (panel->shown);
+    panel->shown = memchr (picker.shown, FALSE, n)
+      ? g_byte_array_append (g_byte_array_sized_new (n), picker.shown, n)
+      : NULL;
+
+    panel->fixed_range =
+      gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (fixed));
+    for (gint j = 0; j < 4; j++)
+      panel->range[j] =
+	gtk_spin_button_get_value (GTK_SPIN_BUTTON (range_spins[j]));
+
+    gtk_widget_queue_draw (panel->area);
+  }
+  gtk_widget_destroy (dialogue);
+
+  /* leave the Curves dialog filtered as it was */
+  if (g_strcmp0 (saved_filter, curves_model_get_filter (model)))
+    curves_set_filter (saved_filter);
+  g_free (saved_filter);
+  g_free (picker.shown);
+}
+
+static gboolean
+panel_button_cb (GtkWidget      *widget,
+		 GdkEventButton *event,
+		 gpointer        user_data)
+{
+  if (event->type != GDK_2BUTTON_PRESS) return GDK_EVENT_PROPAGATE;
+  panel_dialogue (GPOINTER_TO_INT (user_data));
+  return GDK_EVENT_STOP;
+}
+
+static gboolean
+panel_draw_cb (GtkWidget *widget, cairo_t *cr, gpointer user_data)
+{
+  panels_draw (GPOINTER_TO_INT (user_data), cr);
+  return GDK_EVENT_STOP;
+}
+
+
+/****** layout *****/
+
+static void
+panel_attach (gint idx, GtkWidget *area)
+{
+  panels[idx].area = area;
+  gtk_widget_add_events (area, GDK_BUTTON_PRESS_MASK);
+  g_signal_connect (area, "button-press-event",
+		    G_CALLBACK (panel_button_cb), GINT_TO_POINTER (idx));
+  gtk_widget_set_hexpand (area, TRUE);
+  gtk_widget_set_vexpand (area, TRUE);
+}
+
+GtkWidget *
+panels_new (GtkWidget *first)
+{
+  for (gint i = 0; i < PANELS_MAX; i++) {
+    panels[i].x_idx = PANEL_X_CURVES;
+    panels[i].range[1] = panels[i].range[3] = 1.0;
+  }
+
+  gtk_widget_get_size_request (first, &base_width, &base_height);
+  panels_grid = gtk_grid_new ();
+  gtk_grid_set_row_homogeneous (GTK_GRID (panels_grid), TRUE);
+  gtk_grid_set_column_homogeneous (GTK_GRID (panels_grid), TRUE);
+  panel_attach (0, first);
+  gtk_grid_attach (GTK_GRID (panels_grid), first, 0, 0, 1, 1);
+  return panels_grid;
+}
+
+void
+panels_set_layout (gint rows, gint cols)
+{
+  rows = CLAMP (rows, 1, PANELS_MAX);
+  cols = CLAMP (cols, 1, PANELS_MAX / rows);
+  n_panels = rows * cols;
+
+  for (gint i = 0; i < PANELS_MAX; i++) {
+    panel_s *panel = &panels[i];
+    if (i >= n_panels) {
+      if (panel->area) gtk_widget_destroy (panel->area);
+      panel->area = NULL;
+      continue;
+    }
+    if (!panel->area) {
+      GtkWidget *area = gtk_drawing_area_new ();
+      g_signal_connect (area, "draw",
+			G_CALLBACK (panel_draw_cb), GINT_TO_POINTER (i));
+      panel_attach (i, area);
+      gtk_grid_attach (GTK_GRID (panels_grid), area, i % cols, i / cols, 1, 1);
+      gtk_widget_show (area);
+    }
+    else
+      gtk_container_child_set (GTK_CONTAINER (panels_grid), panel->area,
+			       "left-attach", i % cols,
+			       "top-attach", i / cols,
+			       NULL);
+    gtk_widget_set_size_request (panel->area,
+				 base_width / cols, base_height / rows);
+  }
+}
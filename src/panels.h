@@ -0,0 +1,44 @@
+#ifndef PANELS_H
+#define PANELS_H
+
+/*
+  The plot area is a grid of panels, each showing its own choice of
+  curves against its own x axis and ranges.  Panels read the values
+  the Curves dialog last evaluated, so a curve shown in several panels
+  is evaluated once, and panels on the same x axis share one sample
+  grid.  Each panel keeps its last render and renders again, on a
+  thread pool, only when something it shows has changed.
+*/
+
+#define PANELS_MAX	16
+
+/* first becomes panel 0; its draw handler stays the caller's and should
+   end in panels_draw (0, cr) */
+GtkWidget   *panels_new (GtkWidget *first);
+void	     panels_set_layout (gint rows, gint cols);
+
+/* paints the panel's last render and starts another if it is out of
+   date, returning TRUE if what was painted is current */
+gboolean     panels_draw (gint idx, cairo_t *cr);
+
+/* redraws the panels whose curves, axes, title or size have changed */
+void	     panels_refresh ();
+
+/* waits for renders in flight, which read curve values in place; call
+   before evaluating */
+void	     panels_sync ();
+
+const guchar *panels_get_pixels (gint idx, gint *width, gint *height);
+
+/* what a panel plots, copied out for evaluating away from the model */
+typedef struct {
+  gchar	  **exprs;		// NULL-terminated
+  gint	    x_idx;		// into exprs, -1 for the index axis
+  gboolean  fixed_range;
+  gdouble   range[4];		// xmin, xmax, ymin, ymax
+} panel_plot_s;
+
+void	     panels_get_plot (gint idx, panel_plot_s *plot);
+void	     panels_plot_clear (panel_plot_s *plot);
+
+#endif  // PANELS_H
@@ -0,0 +1,292 @@
+/*
+    This file is part of GNU APL, a free implementation of the
+    ISO/IEC Standard 13751, "Programming Language APL, Extended"
+
+    Copyright (C) 2020 Chris Moller
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#define _GNU_SOURCE
+#include <gtk/gtk.h>
+#include <math.h>
+#include <string.h>
+
+#include <plplot.h>
+
+#include "render.h"
+
+/* plplot keeps its stream state in globals */
+static GMutex plplot_lock;
+
+#define AXES_COLOUR	15
+#define N_CURVE_COLOURS	14	// map0 entries 1 through 14
+
+static void
+series_range (const gdouble *vals, guint64 n, gdouble *min, gdouble *max)
+{
+  for (guint64 i = 0; i < n; i++) {
+    if (!isfinite (vals[i])) continue;
+    if (vals[i] < *min) *min = vals[i];
+    if (vals[i] > *max) *max = vals[i];
+  }
+}
+
+static void
+pad_range (gdouble *min, gdouble *max)
+{
+  if (*min > *max) {		// nothing finite
+    *min = 0.0;
+    *max = 1.0;
+  }
+  else if (*min == *max) {
+    *min -= 0.5;
+    *max += 0.5;
+  }
+}
+
+/*
+  A series with more than DECIMATE_FACTOR samples per pixel column is
+  cut down to the first, lowest, highest and last sample of each
+  column, which draws the same envelope.
+*/
+#define DECIMATE_FACTOR	4
+#define COL_BELOW	(G_MAXUINT32 - 1)	// samples outside a fixed range
+#define COL_ABOVE	G_MAXUINT32
+
+/* memcairo leaves R, G, B, A in byte order; cairo's ARGB32 is a
+   native-endian word with premultiplied alpha */
+static void
+rgba_to_argb32 (guchar *pixels, gint width, gint height)
+{
+  gsize n = (gsize)width * (gsize)height;
+  guint32 *words = (guint32 *)pixels;
+  for (gsize i = 0; i < n; i++) {
+    const guchar *p = pixels + 4 * i;
+    guint32 a = p[3];
+    guint32 r = p[0] * a / 255;
+    guint32 g = p[1] * a / 255;
+    guint32 b = p[2] * a / 255;
+    words[i] = (a << 24) | (r << 16) | (g << 8) | b;
+  }
+}
+
+struct _render_grid_s {
+  gint           ref;
+  GMutex         lock;		// held while building
+  gboolean       built;
+  const gdouble *xs;		// NULL for the index axis
+  gdouble       *index;		// the index axis, once built
+  guint64        n;
+  gint           width;
+  gboolean       fit;
+  gdouble        xmin;
+  gdouble        xmax;
+  guint32       *cols;		// per sample, NULL if not decimating
+  guint64        n_groups;	// runs of samples in the same column
+};
+
+typedef struct {
+  const gdouble *x;
+  const gdouble *y;
+  guint64        n;
+  gdouble       *decimated;	// owns x and y when decimating
+} line_s;
+
+render_grid_s *
+render_grid_new (const series_s *x, guint64 n, gint width,
+		 const gdouble *xrange)
+{
+  render_grid_s *grid = g_new0 (render_grid_s, 1);
+  grid->ref = 1;
+  g_mutex_init (&grid->lock);
+  if (x && x->values) {
+    grid->xs = x->values;
+    grid->n = x->n_values;
+  }
+  else grid->n = n;
+  grid->width = MAX (width, 1);
+  grid->fit = !xrange;
+  if (xrange) {
+    grid->xmin = xrange[0];
+    grid->xmax = xrange[1];
+  }
+  return grid;
+}
+
+render_grid_s *
+render_grid_ref (render_grid_s *grid)
+{
+  g_atomic_int_inc (&grid->ref);
+  return grid;
+}
+
+void
+render_grid_unref (render_grid_s *grid)
+{
+  if (!grid || !g_atomic_int_dec_and_test (&grid->ref)) return;
+  g_mutex_clear (&grid->lock);
+  g_free (grid->index);
+  g_free (grid->cols);
+  g_free (grid);
+}
+
+static void
+grid_build (render_grid_s *grid)
+{
+  g_mutex_lock (&grid->lock);
+  if (grid->built) {
+    g_mutex_unlock (&grid->lock);
+    return;
+  }
+
+  if (!grid->xs) {
+    grid->index = g_new (gdouble, grid->n ? grid->n : 1);
+    for (guint64 i = 0; i < grid->n; i++) grid->index[i] = (gdouble)i;
+  }
+  const gdouble *xs = grid->xs ? grid->xs : grid->index;
+
+  if (grid->fit) {
+    grid->xmin = G_MAXDOUBLE;
+    grid->xmax = -G_MAXDOUBLE;
+    series_range (xs, grid->n, &grid->xmin, &grid->xmax);
+  }
+  pad_range (&grid->xmin, &grid->xmax);
+
+  /* columns only keep the shape of a curve that never doubles back */
+  gboolean monotonic = TRUE;
+  for (guint64 i = 1; monotonic && i < grid->n; i++)
+    if (!(xs[i] >= xs[i - 1])) monotonic = FALSE;
+
+  if (monotonic && grid->n > DECIMATE_FACTOR * (guint64)grid->width) {
+    gdouble scale = (gdouble)grid->width / (grid->xmax - grid->xmin);
+    grid->cols = g_new (guint32, grid->n);
+    for (guint64 i = 0; i < grid->n; i++) {
+      gdouble col = floor ((xs[i] - grid->xmin) * scale);
+      grid->cols[i] = (col < 0.0) ? COL_BELOW
+	: (col >= (gdouble)grid->width) ? COL_ABOVE : (guint32)col;
+      if (i == 0 || grid->cols[i] != grid->cols[i - 1]) grid->n_groups++;
+    }
+  }
+
+  grid->built = TRUE;
+  g_mutex_unlock (&grid->lock);
+}
+
+static void
+decimate (const render_grid_s *grid, const gdouble *xs,
+	  const gdouble *ys, guint64 n, line_s *line)
+{
+  gdouble *dx = g_new (gdouble, 8 * grid->n_groups);
+  gdouble *dy = dx + 4 * grid->n_groups;
+  guint64 out = 0;
+
+  for (guint64 i = 0; i < n;) {
+    guint32 col = grid->cols[i];
+    guint64 first = i, lo = i, hi = i;
+    for (; i < n && grid->cols[i] == col; i++) {
+      if (ys[i] < ys[lo]) lo = i;
+      if (ys[i] > ys[hi]) hi = i;
+    }
+    guint64 pick[4] = {first, MIN (lo, hi), MAX (lo, hi), i - 1};
+    for (guint k = 0; k < 4; k++) {
+      if (k > 0 && pick[k] == pick[k - 1]) continue;
+      dx[out] = xs[pick[k]];
+      dy[out] = ys[pick[k]];
+      out++;
+    }
+  }
+
+  line->x = dx;
+  line->y = dy;
+  line->n = out;
+  line->decimated = dx;
+}
+
+void
+render_plot_grid (guchar *pixels, gint width, gint height,
+		  const gchar *title, render_grid_s *grid,
+		  const series_s *ys, guint n_ys,
+		  const gdouble *yrange)
+{
+  grid_build (grid);
+  const gdouble *xs = grid->xs ? grid->xs : grid->index;
+
+  line_s *lines = g_new0 (line_s, n_ys ? n_ys : 1);
+  gdouble ymin = G_MAXDOUBLE, ymax = -G_MAXDOUBLE;
+  for (guint i = 0; i < n_ys; i++) {
+    if (!ys[i].values) continue;
+    guint64 n = MIN (ys[i].n_values, grid->n);
+    if (grid->cols) decimate (grid, xs, ys[i].values, n, &lines[i]);
+    else {
+      lines[i].x = xs;
+      lines[i].y = ys[i].values;
+      lines[i].n = n;
+    }
+    if (!yrange) series_range (lines[i].y, lines[i].n, &ymin, &ymax);
+  }
+  if (yrange) {
+    ymin = yrange[0];
+    ymax = yrange[1];
+  }
+  pad_range (&ymin, &ymax);
+
+  memset (pixels, 0xff, 4 * (gsize)width * (gsize)height);
+
+  g_mutex_lock (&plplot_lock);
+  plsdev ("memcairo");
+  plsmema ((PLINT)width, (PLINT)height, pixels);
+  plscolbg (255, 255, 255);
+  plscol0 (AXES_COLOUR, 0, 0, 0);
+  plinit ();
+
+  plcol0 (AXES_COLOUR);
+  plenv (grid->xmin, grid->xmax, ymin, ymax, 0, 0);
+  pllab ("", "", title ? title : "");
+
+  guint colour = 0;
+  for (guint i = 0; i < n_ys; i++) {
+    if (!lines[i].y) continue;
+    plcol0 ((PLINT)(1 + colour++ % N_CURVE_COLOURS));
+    plline ((PLINT)lines[i].n, lines[i].x, lines[i].y);
+  }
+
+  plend ();
+  g_mutex_unlock (&plplot_lock);
+
+  rgba_to_argb32 (pixels, width, height);
+
+  for (guint i = 0; i < n_ys; i++) g_free (lines[i].decimated);
+  g_free (lines);
+}
+
+void
+render_plot (guchar *pixels, gint width, gint height,
+	     const gchar *title,
+	     const series_s *x, const series_s *ys, guint n_ys,
+	     const gdouble *range)
+{
+  guint64 n_max = 0;
+  for (guint i = 0; i < n_ys; i++)
+    if (ys[i].values && ys[i].n_values > n_max) n_max = ys[i].n_values;
+
+  render_grid_s *grid = render_grid_new (x, n_max, width, range);
+  render_plot_grid (pixels, width, height, title, grid, ys, n_ys,
+		    range ? range + 2 : NULL);
+  render_grid_unref (grid);
+}
@@ -0,0 +1,38 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+typedef struct {
+  gdouble *values;
+  guint64  n_values;
+} series_s;
+
+/* A grid maps each sample of an x axis to the pixel column it lands
+   in, so that every plot sharing the axis can decimate its series to a
+   few points per column.  It is built by whichever render needs it
+   first and may be shared between threads; x must outlive it.  x is
+   NULL, or has NULL values, for the index axis of n samples; xrange is
+   {min, max}, or NULL to fit the data. */
+typedef struct _render_grid_s render_grid_s;
+
+render_grid_s *render_grid_new (const series_s *x, guint64 n, gint width,
+				const gdouble *xrange);
+render_grid_s *render_grid_ref (render_grid_s *grid);
+void	       render_grid_unref (render_grid_s *grid);
+
+/* yrange is {min, max}, or NULL to fit the data */
+void render_plot_grid (guchar *pixels, gint width, gint height,
+		       const gchar *title, render_grid_s *grid,
+		       const series_s *ys, guint n_ys,
+		       const gdouble *yrange);
+
+/* Plots ys against x, or against their indices if x is NULL, into a
+   cairo ARGB32 buffer of 4 * width * height bytes, within range
+   {xmin, xmax, ymin, ymax} or fitted to the data if range is NULL.
+   Safe to call from any thread; plplot itself is serialised
+   internally. */
+void render_plot (guchar *pixels, gint width, gint height,
+		  const gchar *title,
+		  const series_s *x, const series_s *ys, guint n_ys,
+		  const gdouble *range);
+
+#endif  // RENDER_H
@@ -0,0 +1,219 @@
+/*
+    This file is part of GNU APL, a free implementation of the
+    ISO/IEC Standard 13751, "Programming Language APL, Extended"
+
+    Copyright (C) 2020 Chris Moller
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#define _GNU_SOURCE
+#include <gtk/gtk.h>
+#include <errno.h>
+#include <string.h>
+
+#include "render.h"
+#include "curves-model.h"
+#include "curves.h"
+#include "eval.h"
+#include "snapshot.h"
+
+/*
+  header, then 4 * width * height bytes of frame, then for each curve
+  a snapshot_curve_s, the label and expression, and the values.  Every
+  section starts on an 8 byte boundary so the values can be read in
+  place.
+*/
+
+#define SNAPSHOT_MAGIC	"APLVSNP2"
+#define SNAPSHOT_FILE	"snapshot"
+#define SNAPSHOT_WS	"workspace"
+
+typedef struct {
+  gchar   magic[8];
+  guint32 width;
+  guint32 height;
+  guint32 n_curves;
+  gint32  x_idx;
+} snapshot_header_s;
+
+typedef struct {
+  guint32 label_len;
+  guint32 expr_len;
+  guint64 n_values;
+} snapshot_curve_s;
+
+#define ALIGN8(n) (((n) + 7) & ~(gsize)7)
+
+gchar *
+snapshot_dir ()
+{
+  return g_build_filename (g_get_user_cache_dir (), "aplvis", NULL);
+}
+
+/* the )LOAD name if a workspace was saved with the snapshot */
+gchar *
+snapshot_workspace (const gchar *dir)
+{
+  gchar *ws = g_build_filename (dir, SNAPSHOT_WS, NULL);
+  gchar *xml = g_strconcat (ws, ".xml", NULL);
+  gboolean have = g_file_test (xml, G_FILE_TEST_IS_REGULAR);
+  g_free (xml);
+  if (have) return ws;
+  g_free (ws);
+  return NULL;
+}
+
+snapshot_s *
+snapshot_load (const gchar *dir)
+{
+  gchar *fn = g_build_filename (dir, SNAPSHOT_FILE, NULL);
+  GMappedFile *file = g_mapped_file_new (fn, FALSE, NULL);
+  g_free (fn);
+  if (!file) return NULL;
+
+  const guchar *base = (const guchar *)g_mapped_file_get_contents (file);
+  gsize len = g_mapped_file_get_length (file);
+  const snapshot_header_s *hdr = (const snapshot_header_s *)base;
+
+  if (len < sizeof (snapshot_header_s)
+      || memcmp (hdr->magic, SNAPSHOT_MAGIC, sizeof (hdr->magic))) {
+    g_mapped_file_unref (file);
+    return NULL;
+  }
+
+  gsize frame_len = 4 * (gsize)hdr->width * (gsize)hdr->height;
+  gsize off = sizeof (snapshot_header_s);
+  if (len - off < frame_len) {
+    g_mapped_file_unref (file);
+    return NULL;
+  }
+
+  snapshot_s *snapshot = g_new0 (snapshot_s, 1);
+  snapshot->file = file;
+  snapshot->pixels = frame_len ? base + off : NULL;
+  snapshot->width = (gint)hdr->width;
+  snapshot->height = (gint)hdr->height;
+  off += ALIGN8 (frame_len);
+
+  /* a truncated file still gives whatever curves precede the damage */
+  CurvesModel *model = NULL;
+  for (guint32 i = 0; i < hdr->n_curves; i++) {
+    if (off > len || len - off < sizeof (snapshot_curve_s)) break;
+    const snapshot_curve_s *rec = (const snapshot_curve_s *)(base + off);
+    gsize text_len = ALIGN8 ((gsize)rec->label_len + rec->expr_len);
+    if (rec->n_values > (len - off) / sizeof (gdouble)
+	|| len - off - sizeof (snapshot_curve_s)
+	< text_len + rec->n_values * sizeof (gdouble))
+      break;
+    off += sizeof (snapshot_curve_s);
+
+    gchar *label = g_strndup ((const gchar *)base + off, rec->label_len);
+    gchar *expr = g_strndup ((const gchar *)base + off + rec->label_len,
+			     rec->expr_len);
+    off += text_len;
+
+    const gdouble *values = (const gdouble *)(base + off);
+    off += rec->n_values * sizeof (gdouble);
+
+    guint idx = curves_add (label, expr);
+    model = curves_get_model ();
+    if (rec->n_values)
+      curves_model_set_mapped_values (model, idx, file, values,
+				      rec->n_values);
+    g_free (label);
+    g_free (expr);
+  }
+  if (model && hdr->x_idx >= 0
+      && (guint)hdr->x_idx < curves_model_get_n_curves (model))
+    curves_model_set_radio (model, INDEPENDENT_X_RADIO_COLUMN, hdr->x_idx);
+
+  return snapshot;
+}
+
+void
+snapshot_free (snapshot_s *snapshot)
+{
+  if (!snapshot) return;
+  g_mapped_file_unref (snapshot->file);
+  g_free (snapshot);
+}
+
+static void
+append_padded (GByteArray *bytes, gconstpointer data, gsize len)
+{
+  static const guint8 zeros[8] = {0};
+  g_byte_array_append (bytes, data, (guint)len);
+  g_byte_array_append (bytes, zeros, (guint)(ALIGN8 (len) - len));
+}
+
+gboolean
+snapshot_save (const gchar *dir,
+	       const guchar *pixels, gint width, gint height,
+	       GError **error)
+{
+  if (g_mkdir_with_parents (dir, 0755) != 0) {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+		 "%s: %s", dir, g_strerror (errno));
+    return FALSE;
+  }
+
+  gchar *ws = g_build_filename (dir, SNAPSHOT_WS, NULL);
+  gchar *cmd = g_strdup_printf (")WSID %s", ws);
+  eval_command (cmd);
+  eval_command (")SAVE");
+  g_free (cmd);
+  g_free (ws);
+
+  CurvesModel *model = curves_get_model ();
+  guint n = curves_model_get_n_curves (model);
+  if (!pixels) width = height = 0;
+
+  snapshot_header_s hdr = {.width    = (guint32)width,
+			   .height   = (guint32)height,
+			   .n_curves = n,
+			   .x_idx    = curves_model_get_radio (model,
+					     INDEPENDENT_X_RADIO_COLUMN)};
+  memcpy (hdr.magic, SNAPSHOT_MAGIC, sizeof (hdr.magic));
+
+  GByteArray *bytes = g_byte_array_new ();
+  append_padded (bytes, &hdr, sizeof (hdr));
+  if (pixels)
+    append_padded (bytes, pixels, 4 * (gsize)width * (gsize)height);
+
+  for (guint i = 0; i < n; i++) {
+    curve_s *curve = curves_model_get_curve (model, i);
+    snapshot_curve_s rec = {.label_len = (guint32)strlen (curve->label),
+			    .expr_len  = (guint32)strlen (curve->expression),
+			    .n_values  = curve->values ? curve->n_values : 0};
+    gchar *text = g_strconcat (curve->label, curve->expression, NULL);
+    append_padded (bytes, &rec, sizeof (rec));
+    append_padded (bytes, text, rec.label_len + rec.expr_len);
+    if (rec.n_values)
+      g_byte_array_append (bytes, (const guint8 *)curve->values,
+			   (guint)(rec.n_values * sizeof (gdouble)));
+    g_free (text);
+  }
+
+  gchar *fn = g_build_filename (dir, SNAPSHOT_FILE, NULL);
+  gboolean rc = g_file_set_contents (fn, (const gchar *)bytes->data,
+				     bytes->len, error);
+  g_free (fn);
+  g_byte_array_unref (bytes);
+  return rc;
+}
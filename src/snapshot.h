@@ -0,0 +1,31 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/*
+  A warm-start snapshot is a directory holding a )SAVEd workspace and
+  one file with the last rendered frame and every curve's label,
+  expression and last result.  The file is laid out to be used in
+  place once mapped.
+*/
+
+typedef struct {
+  GMappedFile  *file;
+  const guchar *pixels;		// ARGB32, NULL if no frame was saved
+  gint          width;
+  gint          height;
+} snapshot_s;
+
+gchar	   *snapshot_dir ();
+gchar	   *snapshot_workspace (const gchar *dir);
+
+/* maps the snapshot and restores its curves, NULL if there isn't one;
+   the curves' values stay in the mapping until they are re-evaluated */
+snapshot_s *snapshot_load (const gchar *dir);
+void	    snapshot_free (snapshot_s *snapshot);
+
+/* the caller must hold eval_lock */
+gboolean    snapshot_save (const gchar *dir,
+			   const guchar *pixels, gint width, gint height,
+			   GError **error);
+
+#endif  // SNAPSHOT_H